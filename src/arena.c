@@ -0,0 +1,160 @@
+/**
+ * @file    arena.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a region-based memory allocator (an "arena"). Memory is
+ * taken from big chunks, one allocation after the other, and is never freed
+ * individually: the whole arena is released at once, or reset to be used
+ * again without giving memory back to the system.
+ * Lists can be allocated in an arena (see LIST_INIT_ARENA in common.h), so
+ * that a structure owning thousands of small lists can be freed in one call.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "common.h"
+
+// Allocations are aligned on 16 bytes, like malloc does
+#define ARENA_ALIGN(_size)	(((_size) + 15) & ~((size_t) 15))
+
+struct arena *arena_init()
+{
+	struct arena *arena;
+
+	arena = malloc(sizeof(struct arena));
+	if (arena == NULL)
+		FATAL_ERROR("malloc");
+	memset(arena, 0, sizeof(struct arena));
+
+	return arena;
+}
+
+/**
+ * Releases all memory of an arena, and the arena itself.
+ */
+void arena_free(struct arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	free(arena);
+}
+
+/**
+ * Forgets all allocations made in an arena, but keeps its chunks to serve the
+ * next ones.
+ */
+void arena_reset(struct arena *arena)
+{
+	struct arena_chunk *chunk;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+		chunk->used = 0;
+
+	arena->current = arena->chunks;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+	void *ptr;
+
+	size = ARENA_ALIGN(size);
+
+	// Use the next chunks if they are already there (after a reset)
+	while (arena->current != NULL
+		&& arena->current->size - arena->current->used < size
+		&& arena->current->next != NULL)
+		arena->current = arena->current->next;
+
+	// Else, add a new chunk after the current one
+	if (arena->current == NULL
+		|| arena->current->size - arena->current->used < size) {
+		chunk = malloc(sizeof(struct arena_chunk)
+			+ (size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE));
+		if (chunk == NULL)
+			FATAL_ERROR("malloc");
+		chunk->size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		chunk->used = 0;
+		if (arena->current == NULL) {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		} else {
+			chunk->next = arena->current->next;
+			arena->current->next = chunk;
+		}
+		arena->current = chunk;
+	}
+
+	ptr = arena->current->data + arena->current->used;
+	arena->current->used += size;
+
+	return ptr;
+}
+
+/**
+ * Grows an allocation. If it is the last one of the current chunk and there
+ * is room after it, it is simply enlarged. Else, it is copied to a new
+ * allocation (the old one is lost until the arena is reset or freed).
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size,
+	size_t new_size)
+{
+	struct arena_chunk *chunk = arena->current;
+	void *new_ptr;
+
+	if (ptr == NULL)
+		return arena_alloc(arena, new_size);
+
+	old_size = ARENA_ALIGN(old_size);
+	new_size = ARENA_ALIGN(new_size);
+
+	if (chunk != NULL && (char *) ptr + old_size == chunk->data + chunk->used
+		&& chunk->used - old_size + new_size <= chunk->size) {
+		chunk->used = chunk->used - old_size + new_size;
+		return ptr;
+	}
+
+	new_ptr = arena_alloc(arena, new_size);
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+
+	return new_ptr;
+}
+
+/**
+ * Returns the memory held by an arena, in bytes.
+ */
+size_t arena_size(struct arena *arena)
+{
+	struct arena_chunk *chunk;
+	size_t size = 0;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+		size += sizeof(struct arena_chunk) + chunk->size;
+
+	return size;
+}
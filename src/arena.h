@@ -0,0 +1,59 @@
+/**
+ * @file    arena.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a region-based memory allocator (an "arena"). Memory is
+ * taken from big chunks, one allocation after the other, and is never freed
+ * individually: the whole arena is released at once, or reset to be used
+ * again without giving memory back to the system.
+ * Lists can be allocated in an arena (see LIST_INIT_ARENA in common.h), so
+ * that a structure owning thousands of small lists can be freed in one call.
+ */
+
+#if !defined(ARENA_H)
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE	(256 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(16)));
+};
+
+struct arena {
+	struct arena_chunk *chunks;
+	struct arena_chunk *current;
+};
+
+struct arena *arena_init();
+void arena_free(struct arena *arena);
+void arena_reset(struct arena *arena);
+
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size,
+	size_t new_size);
+
+size_t arena_size(struct arena *arena);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file    arm_instr_table_gen.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This program generates the decoding table used by arm_instr_decode(), in
+ * arm_instr_table.c. Each entry is computed from bits 20-27 and 4-7 of an
+ * instruction, which are enough to know what it may be.
+ * c.f. ARM Architecture Reference Manual, figure A3-1.
+ */
+
+#include <stdio.h>
+
+#include "arm_instructions.h"
+
+/**
+ * Computes the table entry of instructions, from their bits 20-27 and 4-7.
+ */
+static uint8_t arm_instr_table_entry(uint32_t bits_20_27, uint32_t bits_4_7)
+{
+	uint32_t threebits = (bits_20_27 >> 5) & 7;
+	uint32_t opcode = (bits_20_27 >> 1) & 0xf;
+	uint32_t l = bits_20_27 & 1;
+	uint8_t entry = ARM_INSTR_TABLE_OTHER;
+
+	// Data processing immediate/register shift
+	if (threebits == 0) {
+		// This really affects PC, if Rd is PC
+		if ((opcode >> 2) != 2) {
+			entry = ARM_INSTR_TABLE_BRANCH_IF_RD_PC;
+		// BX, BXJ, BLX(2): Rm
+		} else if (opcode == 9 && (bits_4_7 >> 2) == 0
+			&& (bits_4_7 & 3) > 0) {
+			entry = ARM_INSTR_TABLE_BRANCH_DYNAMIC;
+			if (bits_20_27 == 0x12 && (bits_4_7 & 3) == 3) // BLX(2)
+				entry |= ARM_INSTR_TABLE_LINK;
+		}
+
+	// Data processing immediate
+	} else if (threebits == 1) {
+		// This really affects PC, if Rd is PC
+		if ((opcode >> 2) != 2)
+			entry = ARM_INSTR_TABLE_BRANCH_IF_RD_PC;
+
+	// Load/store immediate/register offset
+	} else if (threebits == 2 || threebits == 3) {
+		if (l /* read */)
+			entry = ARM_INSTR_TABLE_BRANCH_IF_RD_PC;
+
+	// Load/store multiple
+	} else if (threebits == 4) {
+		if (l /* read */)
+			entry = ARM_INSTR_TABLE_BRANCH_IF_LIST_PC;
+
+	/* Branch and branch with link
+	 * Can be either B, BL, or BLX(1)
+	 * B:         ----101- -------- -------- -------- (static)
+	 * BL:        ----101- -------- -------- -------- (static)   saves return
+	 * BLX(1):    1111101- -------- -------- -------- (static)   saves return */
+	} else if (threebits == 5) {
+		entry = ARM_INSTR_TABLE_BRANCH_STATIC;
+		if ((bits_20_27 >> 4) & 1)
+			entry |= ARM_INSTR_TABLE_LINK;
+
+	// Software interrupt
+	} else if (((bits_20_27 >> 4) & 0xf) == 0xf) {
+		entry = ARM_INSTR_TABLE_SOFTWARE_INTERRUPT;
+	}
+
+	// Load at immediate offset, which is static if Rn is PC
+	if (bits_20_27 == 0x59)
+		entry |= ARM_INSTR_TABLE_LOAD_STORE;
+
+	return entry;
+}
+
+int main()
+{
+	int i;
+
+	printf("// auto-generated file, use 'make arm_instr_table.c' to "
+		"re-generate it\n\n");
+	printf("#include \"arm_instructions.h\"\n\n");
+	printf("const uint8_t arm_instr_table[4096] = {\n");
+	// One line per value of bits 20-27
+	for (i = 0; i < 4096; i++) {
+		printf("%s0x%02x,", i % 16 == 0 ? "\t" : " ",
+			arm_instr_table_entry(i >> 4, i & 0xf));
+		if (i % 16 == 15)
+			printf(" // 0x%02x\n", i >> 4);
+	}
+	printf("};\n");
+
+	return 0;
+}
@@ -30,21 +30,113 @@
 
 #include "vm.h"
 
-int arm_instr_is_unconditional(uint32_t instr);
+/**
+ * Decoding table, indexed by bits 20-27 and 4-7 of an instruction (cf.
+ * ARM_INSTR_TABLE_INDEX). Each entry gives a class of instruction, and flags.
+ * It is generated by arm_instr_table_gen.c.
+ */
+extern const uint8_t arm_instr_table[4096];
 
-int arm_instr_is_branch(vmptr_t pc, uint32_t instr,
-	struct vm_program *program, vmptr_t *branch_to);
+#define ARM_INSTR_TABLE_INDEX(_instr)	\
+	((((_instr) >> 16) & 0xff0) | (((_instr) >> 4) & 0xf))
 
-int arm_instr_branch_is_static(uint32_t instr);
-int arm_instr_branch_is_bl(uint32_t instr);
-int arm_instr_branch_is_return(uint32_t instr);
-uint32_t arm_instr_branch_static_get_addr(vmptr_t vaddr, uint32_t instr);
-int arm_instr_is_nop(uint32_t instr);
+#define ARM_INSTR_TABLE_CLASS	0x07
+enum {
+	ARM_INSTR_TABLE_OTHER,
+	ARM_INSTR_TABLE_BRANCH_IF_RD_PC, // branch if it writes to Rd == PC
+	ARM_INSTR_TABLE_BRANCH_IF_LIST_PC, // branch if it loads PC from a list
+	ARM_INSTR_TABLE_BRANCH_DYNAMIC, // BX, BXJ, BLX(2)
+	ARM_INSTR_TABLE_BRANCH_STATIC, // B, BL, BLX(1)
+	ARM_INSTR_TABLE_SOFTWARE_INTERRUPT
+};
+#define ARM_INSTR_TABLE_LINK	0x08 // branch with link
+#define ARM_INSTR_TABLE_LOAD_STORE	0x10 // load at immediate offset from Rn
 
-int arm_instr_is_software_interrupt(uint32_t instr);
-uint32_t arm_instr_mov_r7_immediate_get_value(uint32_t instr);
+/**
+ * The only branches recognized as returns: "bx lr" and "ldmfd sp!, {fp, pc}".
+ */
+#define ARM_INSTR_IS_RETURN(_instr)	\
+	((_instr) == 0xe12fff1e || (_instr) == 0xe8bd8800)
+
+/**
+ * An instruction, as decoded by arm_instr_decode().
+ */
+struct arm_instr_decoded {
+	enum {
+		ARM_INSTR_OTHER,
+		ARM_INSTR_BRANCH,
+		ARM_INSTR_LOAD_STORE_STATIC,
+		ARM_INSTR_SOFTWARE_INTERRUPT,
+		ARM_INSTR_UNSUPPORTED // BLX(1)
+	} type;
+	uint32_t instr;
+	int unconditional;
+	int link; // branch saves a return address (BL, BLX)
+	int ret; // branch is a return
+	vmptr_t target; // address of a static branch or load, else 0
+};
 
-int arm_instr_is_load_store_static(uint32_t instr);
-uint32_t arm_instr_load_store_static_get_addr(uint32_t instr, vmptr_t pc);
+/**
+ * Decodes an ARM instruction with one table lookup: tells if it is a branch
+ * (an instruction that affects PC), a load or a store at immediate offset from
+ * PC, or a software interrupt.
+ * For a branch, also tries to compute the address it jumps to. If it fails,
+ * target is set to 0.
+ * BLX(1) is a BL to a Thumb instruction, which does not exist in ARMv5: it is
+ * reported as unsupported.
+ */
+static inline void arm_instr_decode(vmptr_t pc, uint32_t instr,
+	struct arm_instr_decoded *d)
+{
+	uint8_t entry = arm_instr_table[ARM_INSTR_TABLE_INDEX(instr)];
+
+	d->type = ARM_INSTR_OTHER;
+	d->instr = instr;
+	d->unconditional = ((instr >> 28) & 15) >= 0xe;
+	d->link = 0;
+	d->ret = 0;
+	d->target = 0;
+
+	switch (entry & ARM_INSTR_TABLE_CLASS) {
+	case ARM_INSTR_TABLE_BRANCH_IF_RD_PC:
+		if (((instr >> 12) & 0xf) == 15)
+			d->type = ARM_INSTR_BRANCH;
+		break;
+	case ARM_INSTR_TABLE_BRANCH_IF_LIST_PC:
+		if ((instr >> 15) & 1)
+			d->type = ARM_INSTR_BRANCH;
+		break;
+	case ARM_INSTR_TABLE_BRANCH_DYNAMIC:
+		d->type = ARM_INSTR_BRANCH;
+		break;
+	case ARM_INSTR_TABLE_BRANCH_STATIC:
+		if (((instr >> 28) & 0xf) == 0xf) {
+			d->type = ARM_INSTR_UNSUPPORTED;
+			break;
+		}
+		d->type = ARM_INSTR_BRANCH;
+		// Sign-extending the 24bit immediate to 30 bit
+		if (instr & 0x800000) // negative
+			d->target = pc + 8 + (0xfe000000 | ((instr & 0x7fffff) << 2));
+		else // positive
+			d->target = pc + 8 + ((instr & 0xffffff) << 2);
+		break;
+	case ARM_INSTR_TABLE_SOFTWARE_INTERRUPT:
+		d->type = ARM_INSTR_SOFTWARE_INTERRUPT;
+		break;
+	}
+
+	if (d->type == ARM_INSTR_BRANCH) {
+		d->link = (entry & ARM_INSTR_TABLE_LINK) != 0;
+		d->ret = ARM_INSTR_IS_RETURN(instr);
+	} else if ((entry & ARM_INSTR_TABLE_LOAD_STORE)
+		&& ((instr >> 16) & 0xf) == 15) {
+		// TODO: what if negative immediate?
+		d->type = ARM_INSTR_LOAD_STORE_STATIC;
+		d->target = pc + (instr & 0xfff) + 8;
+	}
+}
+
+uint32_t arm_instr_mov_r7_immediate_get_value(uint32_t instr);
 
 #endif
@@ -19,11 +19,13 @@
  *
  * @section DESCRIPTION
  *
- * This file provides a function to sort an array, using its 'addr' attribute as
- * the key. We use the merge-sort algorithm, which is a stable sort with
- * performance in O(n*log(n)).
+ * This file provides functions to sort an array.
+ * merge_sort() uses a comparison function, with performance in O(n*log(n)).
+ * radix_sort() is to be preferred when the key is a 32-bit integer inside the
+ * elements (like an address): it is a stable sort with performance in O(n).
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -97,6 +99,104 @@ void merge_sort(void *array, size_t element_size, int length,
 		merge_sort_bis(array, element_size, cmp_fn, 0, length - 1);
 }
 
+/**
+ * Insertion sort, used by radix_sort() for small arrays.
+ * Elements are moved only when they are greater than the new one, so the sort
+ * is stable.
+ */
+static void insertion_sort(void *array, size_t element_size, int length,
+	size_t key_offset)
+{
+	char element[element_size];
+	uint32_t key;
+	int i, j;
+
+	for (i = 1; i < length; i++) {
+		key = *((uint32_t *) (array + i*element_size + key_offset));
+		for (j = i; j > 0 && *((uint32_t *) (array + (j - 1)*element_size
+			+ key_offset)) > key; j--) ;
+		if (j == i)
+			continue;
+		memcpy(element, array + i*element_size, element_size);
+		memmove(array + (j + 1)*element_size, array + j*element_size,
+			(i - j)*element_size);
+		memcpy(array + j*element_size, element, element_size);
+	}
+}
+
+/**
+ * LSD radix sort, on a 32-bit key found at key_offset in each element.
+ * Elements are distributed byte by byte, from the least significant one, and
+ * each distribution keeps the previous order of elements with the same byte:
+ * so the sort is stable. It means that elements can be sorted on several keys
+ * by sorting them first on the less important key, then on the main one.
+ *
+ * cf. http://en.wikipedia.org/wiki/Radix_sort
+ */
+#define RADIX_SORT_MIN_LENGTH	32
+
+void radix_sort(void *array, size_t element_size, int length,
+	size_t key_offset)
+{
+	int counts[4][256];
+	void *scratch, *src, *dst, *temp;
+	uint32_t key;
+	int byte, i, pos, sum;
+
+	if (length < RADIX_SORT_MIN_LENGTH) {
+		insertion_sort(array, element_size, length, key_offset);
+		return;
+	}
+
+	// Count all bytes of all keys, in one pass
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < length; i++) {
+		key = *((uint32_t *) (array + i*element_size + key_offset));
+		counts[0][key & 0xff]++;
+		counts[1][(key >> 8) & 0xff]++;
+		counts[2][(key >> 16) & 0xff]++;
+		counts[3][key >> 24]++;
+	}
+
+	// One scratch buffer for all passes: elements go back and forth
+	scratch = malloc(length * element_size);
+	if (scratch == NULL)
+		FATAL_ERROR("malloc");
+	src = array;
+	dst = scratch;
+
+	for (byte = 0; byte < 4; byte++) {
+		// If all keys have the same byte here, this pass would change nothing
+		key = *((uint32_t *) (array + key_offset));
+		if (counts[byte][(key >> (8 * byte)) & 0xff] == length)
+			continue;
+
+		// Turn counts into positions
+		sum = 0;
+		for (i = 0; i < 256; i++) {
+			pos = sum;
+			sum += counts[byte][i];
+			counts[byte][i] = pos;
+		}
+
+		for (i = 0; i < length; i++) {
+			key = *((uint32_t *) (src + i*element_size + key_offset));
+			pos = counts[byte][(key >> (8 * byte)) & 0xff]++;
+			memcpy(dst + pos*element_size, src + i*element_size,
+				element_size);
+		}
+
+		temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	if (src != array)
+		memcpy(array, src, length * element_size);
+
+	free(scratch);
+}
+
 /*int main()
 {
 	struct statement tableau[] = {
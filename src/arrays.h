@@ -19,17 +19,23 @@
  *
  * @section DESCRIPTION
  *
- * This file provides a function to sort an array, using its 'addr' attribute as
- * the key. We use the merge-sort algorithm, which is a stable sort with
- * performance in O(n*log(n)).
+ * This file provides functions to sort an array.
+ * merge_sort() uses a comparison function, with performance in O(n*log(n)).
+ * radix_sort() is to be preferred when the key is a 32-bit integer inside the
+ * elements (like an address): it is a stable sort with performance in O(n).
  */
 
 #if !defined(ARRAYS_H)
 #define ARRAYS_H
 
+#include <stddef.h>
+
 #include "rebuilt_program.h"
 
 void merge_sort(void *array, size_t element_size, int length,
 	int (*cmp_fn)(const void *, const void *));
 
+void radix_sort(void *array, size_t element_size, int length,
+	size_t key_offset);
+
 #endif
@@ -0,0 +1,252 @@
+/**
+ * @file    bitmaps.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a structure to mark words of the studied program, e.g. to
+ * remember which instructions have already been explored. There is one bit per
+ * 4-byte word of each section loaded by the virtual machine, so testing and
+ * marking an address are O(1) operations.
+ * Addresses that are not in a loaded section can not be marked, and are never
+ * reported as marked.
+ * When ranges are needed, a bitmap can be converted to a group of intervals
+ * by calling bitmap_to_group().
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bitmaps.h"
+#include "common.h"
+#include "groups.h"
+
+/**
+ * Creates a new empty bitmap, covering all sections of a program.
+ */
+struct bitmap *bitmap_init(struct vm_program *program)
+{
+	struct bitmap *bitmap;
+	struct bitmap_section section;
+	size_t words;
+	int i;
+
+	bitmap = malloc(sizeof(struct bitmap));
+	if (bitmap == NULL)
+		FATAL_ERROR("malloc");
+	memset(bitmap, 0, sizeof(struct bitmap));
+
+	bitmap->program = program;
+	LIST_INIT(bitmap->sections);
+	LIST_RESERVE(bitmap->sections, LIST_LENGTH(program->sections));
+
+	LIST_ITERATOR(program->sections, i) {
+		section.vaddr = program->sections[i].vaddr;
+		section.size = program->sections[i].size;
+		// One bit per word, rounded up to a whole number of 64-bit blocks
+		words = (section.size + 3) / 4;
+		section.bits = calloc((words + 63) / 64, sizeof(uint64_t));
+		if (section.bits == NULL)
+			FATAL_ERROR("calloc");
+		LIST_APPEND(bitmap->sections, section);
+	}
+
+	return bitmap;
+}
+
+void bitmap_free(struct bitmap *bitmap)
+{
+	int i;
+
+	LIST_ITERATOR(bitmap->sections, i)
+		free(bitmap->sections[i].bits);
+	LIST_FREE(bitmap->sections);
+
+	free(bitmap);
+}
+
+/**
+ * Finds the section containing a given address, and computes the index of the
+ * corresponding word in it. Returns NULL if the address is not in a section.
+ */
+static struct bitmap_section *bitmap_find(struct bitmap *bitmap,
+	vmptr_t addr, size_t *word)
+{
+	struct bitmap_section *section;
+	int i;
+
+	i = vm_find_section(bitmap->program, addr);
+	if (i < 0)
+		return NULL;
+
+	section = &(bitmap->sections[i]);
+	*word = (addr - section->vaddr) / 4;
+	return section;
+}
+
+/**
+ * Tests if the word at a given address is marked.
+ */
+int bitmap_is_set(struct bitmap *bitmap, vmptr_t addr)
+{
+	struct bitmap_section *section;
+	size_t word;
+
+	section = bitmap_find(bitmap, addr, &word);
+	if (section == NULL)
+		return 0;
+
+	return (section->bits[word / 64] >> (word % 64)) & 1;
+}
+
+/**
+ * Marks the word at a given address.
+ */
+void bitmap_set(struct bitmap *bitmap, vmptr_t addr)
+{
+	struct bitmap_section *section;
+	size_t word;
+
+	section = bitmap_find(bitmap, addr, &word);
+	if (section == NULL)
+		return;
+
+	section->bits[word / 64] |= (uint64_t) 1 << (word % 64);
+}
+
+/**
+ * Marks the word at a given address, and returns whether it was already marked.
+ */
+int bitmap_test_and_set(struct bitmap *bitmap, vmptr_t addr)
+{
+	struct bitmap_section *section;
+	size_t word;
+	uint64_t mask;
+	int ret;
+
+	section = bitmap_find(bitmap, addr, &word);
+	if (section == NULL)
+		return 0;
+
+	mask = (uint64_t) 1 << (word % 64);
+	ret = (section->bits[word / 64] & mask) != 0;
+	section->bits[word / 64] |= mask;
+
+	return ret;
+}
+
+/**
+ * Looks for the first word in [addr, end) whose mark is equal to value, 64
+ * words at a time. The search stops at the end of the section containing
+ * addr: the address where it stopped is returned if no word was found.
+ */
+static vmptr_t bitmap_next(struct bitmap *bitmap, vmptr_t addr, vmptr_t end,
+	int value)
+{
+	struct bitmap_section *section;
+	size_t word, last;
+	uint64_t block;
+
+	section = bitmap_find(bitmap, addr, &word);
+	if (section == NULL || end <= addr)
+		return addr;
+
+	last = (section->size + 3) / 4;
+	if ((end - section->vaddr + 3) / 4 < last)
+		last = (end - section->vaddr + 3) / 4;
+
+	while (word < last) {
+		block = value ? section->bits[word / 64] : ~section->bits[word / 64];
+		block &= ~(uint64_t) 0 << (word % 64);
+		if (block != 0) {
+			word = (word & ~(size_t) 63) + __builtin_ctzll(block);
+			break;
+		}
+		word = (word & ~(size_t) 63) + 64;
+	}
+	if (word > last)
+		word = last;
+
+	addr = section->vaddr + word * 4;
+	return addr < end ? addr : end;
+}
+
+/**
+ * Returns the first marked address in [addr, end), or where the search
+ * stopped (cf. bitmap_next).
+ */
+vmptr_t bitmap_next_set(struct bitmap *bitmap, vmptr_t addr, vmptr_t end)
+{
+	return bitmap_next(bitmap, addr, end, 1);
+}
+
+/**
+ * Returns the first address not marked in [addr, end), or where the search
+ * stopped (cf. bitmap_next).
+ */
+vmptr_t bitmap_next_clear(struct bitmap *bitmap, vmptr_t addr, vmptr_t end)
+{
+	return bitmap_next(bitmap, addr, end, 0);
+}
+
+/**
+ * Marks all words in [start, end), which must be in the same section.
+ */
+void bitmap_set_range(struct bitmap *bitmap, vmptr_t start, vmptr_t end)
+{
+	struct bitmap_section *section;
+	size_t word, last;
+
+	section = bitmap_find(bitmap, start, &word);
+	if (section == NULL || end <= start)
+		return;
+
+	last = (end - section->vaddr + 3) / 4;
+	for (; word < last && word % 64 != 0; word++)
+		section->bits[word / 64] |= (uint64_t) 1 << (word % 64);
+	for (; word + 64 <= last; word += 64)
+		section->bits[word / 64] = ~(uint64_t) 0;
+	for (; word < last; word++)
+		section->bits[word / 64] |= (uint64_t) 1 << (word % 64);
+}
+
+/**
+ * Adds every range of consecutive marked words to a group of intervals.
+ */
+void bitmap_to_group(struct bitmap *bitmap, struct group *group)
+{
+	struct bitmap_section *section;
+	size_t words, word, start;
+	int i;
+
+	LIST_ITERATOR(bitmap->sections, i) {
+		section = &(bitmap->sections[i]);
+		words = (section->size + 3) / 4;
+		for (word = 0; word < words; word++) {
+			if (!((section->bits[word / 64] >> (word % 64)) & 1))
+				continue;
+			start = word;
+			while (word + 1 < words
+				&& ((section->bits[(word + 1) / 64] >> ((word + 1) % 64)) & 1))
+				word++;
+			group_add_interval(group, section->vaddr + start * 4,
+				section->vaddr + (word + 1) * 4);
+		}
+	}
+}
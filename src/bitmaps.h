@@ -0,0 +1,65 @@
+/**
+ * @file    bitmaps.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a structure to mark words of the studied program, e.g. to
+ * remember which instructions have already been explored. There is one bit per
+ * 4-byte word of each section loaded by the virtual machine, so testing and
+ * marking an address are O(1) operations.
+ * Addresses that are not in a loaded section can not be marked, and are never
+ * reported as marked.
+ * When ranges are needed, a bitmap can be converted to a group of intervals
+ * by calling bitmap_to_group().
+ */
+
+#if !defined(BITMAPS_H)
+#define BITMAPS_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "groups.h"
+#include "vm.h"
+
+struct bitmap_section {
+	vmptr_t vaddr;
+	size_t size;
+	uint64_t *bits;
+};
+
+struct bitmap {
+	struct vm_program *program;
+	struct bitmap_section *sections; // same order as program->sections
+};
+
+struct bitmap *bitmap_init(struct vm_program *program);
+void bitmap_free(struct bitmap *bitmap);
+
+int bitmap_is_set(struct bitmap *bitmap, vmptr_t addr);
+void bitmap_set(struct bitmap *bitmap, vmptr_t addr);
+int bitmap_test_and_set(struct bitmap *bitmap, vmptr_t addr);
+
+vmptr_t bitmap_next_set(struct bitmap *bitmap, vmptr_t addr, vmptr_t end);
+vmptr_t bitmap_next_clear(struct bitmap *bitmap, vmptr_t addr, vmptr_t end);
+void bitmap_set_range(struct bitmap *bitmap, vmptr_t start, vmptr_t end);
+
+void bitmap_to_group(struct bitmap *bitmap, struct group *group);
+
+#endif
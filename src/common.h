@@ -27,6 +27,11 @@
 #define COMMON_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
 
 #define NAMES_LENGTH	64
 #define vmptr_t	uint32_t
@@ -43,42 +48,127 @@
 
 /**
  * How lists are handled:
- * For a list L of 3 elements, here is the memory allocation:
+ * For a list L of 3 elements, with room for 4, here is the memory allocation:
  *
  *        malloc returns this address
- *       /      LIST_INIT returns this address
- *      /______/_______________________
- *     [       ¦       ¦       ¦       ]
- *     [   3   ¦  val  ¦  val  ¦  val  ]
- *     [_______¦_______¦_______¦_______]
- *      \       \       \
- *       \       \       pointer to L[1]
- *        \       pointer to *L and L[0]
- *         contains L's length
+ *       /              LIST_INIT returns this address
+ *      /______________/_______________________________
+ *     [       ¦       ¦       ¦       ¦       ¦       ]
+ *     [  3|4  ¦ arena ¦  val  ¦  val  ¦  val  ¦       ]
+ *     [_______¦_______¦_______¦_______¦_______¦_______]
+ *      \       \       \       \
+ *       \       \       \       pointer to L[1]
+ *        \       \       pointer to *L and L[0]
+ *         \       arena the list belongs to, or NULL
+ *          contains L's length and capacity
+ *
+ * The header is padded to 16 bytes, so that elements are always aligned.
+ * When the list is full, its capacity is doubled, so appending an element is
+ * done in constant amortized time. Removing elements never shrinks the list.
+ * A new list already has room for a few elements, so that the many tiny lists
+ * (statements of small functions, etc.) are allocated only once.
+ * A list initialized with LIST_INIT_ARENA is allocated in an arena: LIST_FREE
+ * does nothing, the memory is released with the arena.
+ */
+struct list_header {
+	int length;
+	int capacity;
+	struct arena *arena;
+};
+
+#define LIST_HEADER_SIZE	16
+#define LIST_INITIAL_CAPACITY	4
+
+#define LIST_HEADER(_list)	\
+	((struct list_header *) ((char *) (_list) - LIST_HEADER_SIZE))
+
+/**
+ * Allocates a new list, with room for capacity elements.
+ */
+static inline void *list_alloc(size_t element_size, int capacity,
+	struct arena *arena)
+{
+	struct list_header *header;
+	size_t size = LIST_HEADER_SIZE + capacity * element_size;
+
+	header = arena != NULL ? arena_alloc(arena, size) : malloc(size);
+	if (header == NULL)
+		FATAL_ERROR("malloc");
+	header->length = 0;
+	header->capacity = capacity;
+	header->arena = arena;
+
+	return (char *) header + LIST_HEADER_SIZE;
+}
+
+/**
+ * Reallocates a list, so that it has room for capacity elements.
  */
+static inline void *list_realloc(void *list, size_t element_size,
+	int capacity)
+{
+	struct list_header *header = LIST_HEADER(list);
+
+	if (header->arena != NULL)
+		header = arena_realloc(header->arena, header, LIST_HEADER_SIZE
+			+ header->capacity * element_size,
+			LIST_HEADER_SIZE + capacity * element_size);
+	else
+		header = realloc(header, LIST_HEADER_SIZE + capacity * element_size);
+	if (header == NULL)
+		FATAL_ERROR("realloc");
+	header->capacity = capacity;
+
+	return (char *) header + LIST_HEADER_SIZE;
+}
+
 #define LIST_INIT(_list)	\
 	do {\
-		_list = malloc(sizeof(*(_list)));\
-		if (_list == NULL)\
-			FATAL_ERROR("malloc");\
-		*((int *) (_list)) = 0;\
-		_list += 1;\
+		_list = (typeof(_list)) list_alloc(sizeof(*(_list)),\
+			LIST_INITIAL_CAPACITY, NULL);\
+	} while (0)
+
+#define LIST_INIT_ARENA(_list, _arena)	\
+	do {\
+		_list = (typeof(_list)) list_alloc(sizeof(*(_list)),\
+			LIST_INITIAL_CAPACITY, _arena);\
 	} while (0)
 
 #define LIST_FREE(_list)	\
 	do {\
-		free((_list) - 1);\
+		if (LIST_HEADER(_list)->arena == NULL)\
+			free(LIST_HEADER(_list));\
 		_list = NULL;\
 	} while (0)
 
 #define LIST_LENGTH(_list)	\
-	(*((int *) ((_list) - 1)))
+	(LIST_HEADER(_list)->length)
+
+#define LIST_CAPACITY(_list)	\
+	(LIST_HEADER(_list)->capacity)
+
+/**
+ * Makes sure the list has room for at least _capacity elements, so that
+ * appending up to that number of elements does not reallocate it.
+ */
+#define LIST_RESERVE(_list, _capacity)	\
+	do {\
+		if (LIST_CAPACITY(_list) < (_capacity))\
+			_list = (typeof(_list)) list_realloc(_list, sizeof(*(_list)),\
+				_capacity);\
+	} while (0)
+
+#define LIST_GROW(_list)	\
+	do {\
+		if (LIST_LENGTH(_list) == LIST_CAPACITY(_list))\
+			_list = (typeof(_list)) list_realloc(_list, sizeof(*(_list)),\
+				LIST_CAPACITY(_list) < LIST_INITIAL_CAPACITY ?\
+				LIST_INITIAL_CAPACITY : 2 * LIST_CAPACITY(_list));\
+	} while (0)
 
 #define LIST_APPEND(_list, _element)	\
 	do {\
-		_list = (typeof(_list)) realloc((_list) - 1, (LIST_LENGTH(_list) + 2) * sizeof(*(_list))) + 1;\
-		if (_list == NULL)\
-			FATAL_ERROR("realloc");\
+		LIST_GROW(_list);\
 		(_list)[LIST_LENGTH(_list)] = _element;\
 		LIST_LENGTH(_list)++;\
 	} while (0)
@@ -96,9 +186,7 @@
 
 #define LIST_ADD(_list, _element, _offset)	\
 	do {\
-		_list = (typeof(_list)) realloc((_list) - 1, (LIST_LENGTH(_list) + 2) * sizeof(*(_list))) + 1;\
-		if (_list == NULL)\
-			FATAL_ERROR("realloc");\
+		LIST_GROW(_list);\
 		memmove(&((_list)[(_offset) + 1]), &((_list)[(_offset)]), (LIST_LENGTH(_list) - (_offset)) * sizeof(*(_list)));\
 		(_list)[_offset] = _element;\
 		LIST_LENGTH(_list)++;\
@@ -107,9 +195,6 @@
 #define LIST_REMOVE(_list, _offset)	\
 	do {\
 		memmove(&((_list)[(_offset)]), &((_list)[(_offset) + 1]), (LIST_LENGTH(_list) - 1 - (_offset)) * sizeof(*(_list)));\
-		_list = (typeof(_list)) realloc((_list) - 1, LIST_LENGTH(_list) * sizeof(*(_list))) + 1;\
-		if (_list == NULL)\
-			FATAL_ERROR("realloc");\
 		LIST_LENGTH(_list)--;\
 	} while (0)
 
@@ -0,0 +1,387 @@
+/**
+ * @file    database.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file saves rebuilt programs in database files, and loads them back
+ * with a single mmap(): the lists of the rebuilt program are fixed up to point
+ * into the mapping instead of being read and copied.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "database.h"
+#include "groups.h"
+#include "hashsets.h"
+
+// Sizes of the structures in a database
+#define DATABASE_LAYOUT	\
+	((uint32_t) (sizeof(struct rebuilt_function) << 16\
+		| sizeof(struct function_start) << 8 | sizeof(struct list_header)))
+
+/**
+ * Sizes of the elements of the lists, in the order of the DATABASE_* values.
+ */
+static const size_t database_element_sizes[DATABASE_LISTS] = {
+	sizeof(vmptr_t), // addresses of statements
+	sizeof(vmptr_t), // addresses they go to
+	sizeof(uint32_t), // values
+	sizeof(int), // functions they go to
+	sizeof(uint8_t), // flags
+	sizeof(struct rebuilt_function),
+	sizeof(struct function_start),
+	sizeof(struct interval),
+	sizeof(char), // strings
+};
+
+/**
+ * Hash function for the content of a program (FNV-1a, 8 bytes at a time, with
+ * high bits folded into low ones).
+ */
+uint64_t database_hash(const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	uint64_t hash = 14695981039346656037ull, word;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+/**
+ * Hashes the content of a file. Returns 0 on success.
+ */
+int database_hash_file(const char *filename, uint64_t *hash, uint64_t *size)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	*size = st.st_size;
+	if (st.st_size == 0) {
+		close(fd);
+		*hash = database_hash(NULL, 0);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	*hash = database_hash(map, st.st_size);
+	munmap(map, st.st_size);
+
+	return 0;
+}
+
+/**
+ * Writes a list as it is in memory, aligned on 16 bytes like in memory: its
+ * header (without arena), then its elements. Sets the offset of the header.
+ */
+static void database_write_list(FILE *file, const void *elements, int length,
+	size_t element_size, uint32_t *offset)
+{
+	char header[LIST_HEADER_SIZE];
+	struct list_header *list_header = (struct list_header *) header;
+
+	memset(header, 0, LIST_HEADER_SIZE);
+	while (ftell(file) % LIST_HEADER_SIZE != 0)
+		fputc(0, file);
+	*offset = ftell(file);
+
+	list_header->length = length;
+	list_header->capacity = length;
+	fwrite(header, LIST_HEADER_SIZE, 1, file);
+	fwrite(elements, element_size, length, file);
+}
+
+/**
+ * Saves a rebuilt program in a database file, for a program and a mode of
+ * decompilation. The file is written under another name, then renamed: a
+ * database being written is never read.
+ */
+void database_write(const char *filename, struct vm_program *program,
+	struct rebuilt_program *rp, int mode)
+{
+	struct database_header header;
+	struct statements *st = &(rp->statements);
+	struct interval *explored;
+	const void *lists[DATABASE_LISTS];
+	int lengths[DATABASE_LISTS];
+	char *temporary;
+	FILE *file;
+	int i;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = DATABASE_MAGIC;
+	header.version = DATABASE_VERSION;
+	header.layout = DATABASE_LAYOUT;
+	header.mode = mode;
+	header.program_hash = database_hash(program->file_map, program->file_size);
+	header.program_size = program->file_size;
+	header.entry_function = rp->entry_function;
+
+	LIST_INIT(explored);
+	group_get_intervals(rp->explored, &explored);
+
+	lists[DATABASE_ADDR] = st->addr;
+	lists[DATABASE_TO_ADDR] = st->to_addr;
+	lists[DATABASE_VALUE] = st->value;
+	lists[DATABASE_TO_FUNCTION] = st->to_function;
+	lists[DATABASE_FLAGS] = st->flags;
+	lists[DATABASE_FUNCTIONS] = rp->functions;
+	lists[DATABASE_FUNCTIONS_INDEX] = rp->functions_index;
+	lists[DATABASE_EXPLORED] = explored;
+	for (i = 0; i < DATABASE_STRINGS; i++)
+		lengths[i] = LIST_LENGTH(lists[i]);
+	lists[DATABASE_STRINGS] = rp->strings->data;
+	lengths[DATABASE_STRINGS] = rp->strings->length;
+
+	temporary = malloc(strlen(filename) + 5);
+	if (temporary == NULL)
+		FATAL_ERROR("malloc");
+	sprintf(temporary, "%s.tmp", filename);
+	file = fopen(temporary, "wb");
+	if (file == NULL)
+		FATAL_ERROR("can not write %s", temporary);
+
+	// The header is written again at the end, with the offsets of the lists
+	fwrite(&header, sizeof(header), 1, file);
+	for (i = 0; i < DATABASE_LISTS; i++)
+		database_write_list(file, lists[i], lengths[i],
+			database_element_sizes[i], &(header.lists[i]));
+	rewind(file);
+	fwrite(&header, sizeof(header), 1, file);
+
+	i = ferror(file);
+	if (fclose(file) != 0 || i != 0)
+		FATAL_ERROR("can not write %s", temporary);
+	if (rename(temporary, filename) != 0)
+		FATAL_ERROR("can not rename %s", temporary);
+
+	free(temporary);
+	LIST_FREE(explored);
+}
+
+// Elements of a list in a mapped database
+#define DATABASE_LIST_DATA(_list)	\
+	((void *) ((char *) (_list) + LIST_HEADER_SIZE))
+
+/**
+ * Checks that the ids, statements spans and names a database's lists refer to
+ * exist, so that a corrupted file cannot make queries read out of bounds.
+ */
+static int database_is_consistent(struct database_header *header)
+{
+	struct list_header *lists[DATABASE_LISTS];
+	struct rebuilt_function *functions;
+	struct function_start *functions_index;
+	int *to_function;
+	char *strings;
+	int i, functions_count, statements_count, strings_length;
+
+	for (i = 0; i < DATABASE_LISTS; i++)
+		lists[i] = (struct list_header *) ((char *) header + header->lists[i]);
+	functions = DATABASE_LIST_DATA(lists[DATABASE_FUNCTIONS]);
+	functions_index = DATABASE_LIST_DATA(lists[DATABASE_FUNCTIONS_INDEX]);
+	to_function = DATABASE_LIST_DATA(lists[DATABASE_TO_FUNCTION]);
+	strings = DATABASE_LIST_DATA(lists[DATABASE_STRINGS]);
+	functions_count = lists[DATABASE_FUNCTIONS]->length;
+	statements_count = lists[DATABASE_ADDR]->length;
+	strings_length = lists[DATABASE_STRINGS]->length;
+
+	// The statements' lists are the columns of one table
+	for (i = DATABASE_TO_ADDR; i <= DATABASE_FLAGS; i++)
+		if (lists[i]->length != statements_count)
+			return 0;
+	// Names must end in the strings table
+	if (strings_length == 0 || strings[strings_length - 1] != '\0')
+		return 0;
+	if (header->entry_function < 0
+		|| header->entry_function >= functions_count)
+		return 0;
+
+	for (i = 0; i < functions_count; i++)
+		if (functions[i].id != i
+			|| functions[i].first_statement < 0
+			|| functions[i].statements_count < 0
+			|| functions[i].first_statement
+				> statements_count - functions[i].statements_count
+			|| functions[i].name >= (uint32_t) strings_length
+			|| functions[i].tail_function < -1
+			|| functions[i].tail_function >= functions_count)
+			return 0;
+	for (i = 0; i < statements_count; i++)
+		if (to_function[i] < -1 || to_function[i] >= functions_count)
+			return 0;
+	for (i = 0; i < lists[DATABASE_FUNCTIONS_INDEX]->length; i++)
+		if (functions_index[i].id < 0
+			|| functions_index[i].id >= functions_count)
+			return 0;
+
+	return 1;
+}
+
+/**
+ * Checks that a database was made from a program and in a mode, and that its
+ * lists are in the file and consistent.
+ */
+static int database_is_valid(struct database_header *header, size_t size,
+	uint64_t program_hash, uint64_t program_size, int mode)
+{
+	struct list_header *list;
+	int i;
+
+	if (header->magic != DATABASE_MAGIC
+		|| header->version != DATABASE_VERSION
+		|| header->layout != DATABASE_LAYOUT
+		|| header->mode != (uint32_t) mode
+		|| header->program_hash != program_hash
+		|| header->program_size != program_size)
+		return 0;
+
+	for (i = 0; i < DATABASE_LISTS; i++) {
+		if (header->lists[i] % LIST_HEADER_SIZE != 0
+			|| header->lists[i] < sizeof(*header)
+			|| header->lists[i] > size - LIST_HEADER_SIZE)
+			return 0;
+		list = (struct list_header *) ((char *) header + header->lists[i]);
+		if (list->length < 0 || (size - header->lists[i] - LIST_HEADER_SIZE)
+			/ database_element_sizes[i] < (size_t) list->length)
+			return 0;
+	}
+
+	return database_is_consistent(header);
+}
+
+/**
+ * Loads the database of a program, if it exists and was made from a program
+ * with the same content, in the same mode. Else, returns NULL, and the program
+ * needs to be decompiled.
+ * The given rebuilt program must be empty (new, or emptied by rp_reset()); it is
+ * filled, and still belongs to the caller, who frees it after database_close().
+ * Its lists point into the mapped file: they are in the rebuilt program's
+ * arena, so that they are copied if they ever grow.
+ */
+struct database *database_open(const char *filename,
+	const char *program_filename, int mode, struct rebuilt_program *rp)
+{
+	struct database_header *header;
+	struct database *database;
+	struct list_header *list;
+	struct interval *explored;
+	void *lists[DATABASE_LISTS];
+	uint64_t program_hash, program_size;
+	struct stat st;
+	void *map;
+	int fd, i, f_id;
+
+	fd = open(filename, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*header)) {
+		close(fd);
+		return NULL;
+	}
+	// Lists are written in place (their arena): pages are copied if needed
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	header = map;
+	if (database_hash_file(program_filename, &program_hash,
+		&program_size) != 0
+		|| !database_is_valid(header, st.st_size, program_hash,
+		program_size, mode)) {
+		fprintf(stderr, "warning: database %s was not made from %s in "
+			"this mode, or is invalid: ignoring it\n", filename,
+			program_filename);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	database = malloc(sizeof(struct database));
+	if (database == NULL)
+		FATAL_ERROR("malloc");
+	memset(database, 0, sizeof(struct database));
+	database->map = map;
+	database->size = st.st_size;
+	database->rp = rp;
+
+	for (i = 0; i < DATABASE_LISTS; i++) {
+		list = (struct list_header *) ((char *) map + header->lists[i]);
+		list->capacity = list->length;
+		list->arena = rp->arena;
+		lists[i] = (char *) list + LIST_HEADER_SIZE;
+	}
+
+	rp->statements.addr = lists[DATABASE_ADDR];
+	rp->statements.to_addr = lists[DATABASE_TO_ADDR];
+	rp->statements.value = lists[DATABASE_VALUE];
+	rp->statements.to_function = lists[DATABASE_TO_FUNCTION];
+	rp->statements.flags = lists[DATABASE_FLAGS];
+	rp->functions = lists[DATABASE_FUNCTIONS];
+	rp->functions_index = lists[DATABASE_FUNCTIONS_INDEX];
+	rp->entry_function = header->entry_function;
+
+	database->strings.data = lists[DATABASE_STRINGS];
+	database->strings.length = LIST_LENGTH(database->strings.data);
+	database->strings.capacity = database->strings.length;
+	rp->strings = &(database->strings);
+
+	// If several functions start at the same address, the first one is found
+	LIST_ITERATOR(rp->functions, i)
+		if (!hashmap_get(rp->functions_by_addr, rp->functions[i].vaddr_start,
+			&f_id))
+			hashmap_set(rp->functions_by_addr, rp->functions[i].vaddr_start, i);
+	explored = lists[DATABASE_EXPLORED];
+	LIST_ITERATOR(explored, i)
+		group_add_interval(rp->explored, explored[i].start, explored[i].end);
+
+	return database;
+}
+
+void database_close(struct database *database)
+{
+	munmap(database->map, database->size);
+
+	free(database);
+}
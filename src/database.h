@@ -0,0 +1,92 @@
+/**
+ * @file    database.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a way to save the result of a decompilation (a rebuilt
+ * program: functions, sorted statements, names and explored ranges) in a file,
+ * the "database" of the analysed program, and to load it again without
+ * decompiling. The database is only used if it was made from a program with
+ * exactly the same content, in the same mode.
+ * Lists are written as they are in memory (cf. common.h), so that loading a
+ * database is only mapping the file in memory: lists point into the mapping.
+ * Numbers are in the byte order of the machine that wrote the file.
+ */
+
+#if !defined(DATABASE_H)
+#define DATABASE_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "rebuilt_program.h"
+#include "strtab.h"
+#include "vm.h"
+
+#define DATABASE_MAGIC	0x42444141 // "AADB"
+#define DATABASE_VERSION	1
+// Default database of a program: its file name with this suffix
+#define DATABASE_SUFFIX	".aadb"
+
+enum {
+	DATABASE_ADDR,
+	DATABASE_TO_ADDR,
+	DATABASE_VALUE,
+	DATABASE_TO_FUNCTION,
+	DATABASE_FLAGS,
+	DATABASE_FUNCTIONS,
+	DATABASE_FUNCTIONS_INDEX,
+	DATABASE_EXPLORED,
+	DATABASE_STRINGS,
+	DATABASE_LISTS
+};
+
+/**
+ * Header of a database file. It is followed by the lists, each one at a given
+ * offset, aligned on 16 bytes: a list header, then the elements.
+ */
+struct database_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t layout; // sizes of the structures, to detect another ABI
+	uint32_t mode; // cf. decompile()
+	uint64_t program_hash; // of the content of the analysed program
+	uint64_t program_size;
+	int32_t entry_function;
+	uint32_t lists[DATABASE_LISTS]; // offsets of the lists in the file
+};
+
+struct database {
+	void *map;
+	size_t size;
+	struct strtab strings; // points into the map
+	struct rebuilt_program *rp;
+};
+
+uint64_t database_hash(const void *data, size_t size);
+int database_hash_file(const char *filename, uint64_t *hash, uint64_t *size);
+
+void database_write(const char *filename, struct vm_program *program,
+	struct rebuilt_program *rp, int mode);
+
+struct database *database_open(const char *filename,
+	const char *program_filename, int mode, struct rebuilt_program *rp);
+void database_close(struct database *database);
+
+#endif
@@ -26,10 +26,20 @@
 
 #include "arm_instructions.h"
 #include "arrays.h"
+#include "bitmaps.h"
 #include "common.h"
 #include "decompiler.h"
 #include "groups.h"
+#include "hashsets.h"
 #include "rebuilt_program.h"
+#include "scanner.h"
+#include "sweep.h"
+#include "workers.h"
+
+// Threads are given ranges of at least this number of functions (or other
+// items), and this number of ranges each on average, to balance the work
+#define DECOMPILE_RANGE_MIN_SIZE	64
+#define DECOMPILE_RANGES_PER_JOB	4
 
 /**
  * Sets the name of a rebuilt_program's function, by looking into the symbol
@@ -39,11 +49,119 @@ static void decompile_set_function_name(struct vm_program *program,
 	struct rebuilt_program *rp, vmptr_t function_id, vmptr_t vaddr)
 {
 	char function_name[NAMES_LENGTH];
+	uint32_t name;
 
-	if (vm_get_symbol_name(program, vaddr, function_name) != 0)
+	if (vm_get_symbol_name(program, vaddr, &name) != 0) {
 		snprintf(function_name, NAMES_LENGTH - 1, "f%d", (int) function_id);
+		name = strtab_add(program->strings, function_name);
+	}
+
+	rp_function_set_name(&(rp->functions[function_id]), name);
+}
+
+/**
+ * Finds the number of a system call, by reading the instructions before it:
+ * the number is put in r7 by a "mov r7, #val". Returns -1 if it is not found.
+ */
+static uint32_t decompile_syscall_number(struct vm_program *program,
+	vmptr_t pc)
+{
+	uint32_t instr = 0;
+
+	// The system call may be at the start of a section
+	if (vm_find_section(program, pc - 4) >= 0)
+		instr = vm_read_instruction(program, pc - 4);
+	if ((instr & 0xfffff000) != 0xe3a07000
+		&& vm_find_section(program, pc - 8) >= 0)
+		instr = vm_read_instruction(program, pc - 8);
+	if ((instr & 0xfffff000) == 0xe3a07000) // mov r7, #val
+		return arm_instr_mov_r7_immediate_get_value(instr);
+
+	return -1;
+}
+
+/**
+ * Fills a statement from a decoded branch instruction. A branch just after a
+ * "mov lr, pc" is a call.
+ */
+static void decompile_branch_statement(struct statement *statement,
+	vmptr_t pc, struct arm_instr_decoded *decoded, int after_mov_lr_pc)
+{
+	statement->type = BRANCH;
+	statement->addr = pc;
+	// If the branch address was computed successfully, it is set
+	// in statement->to_addr. Else, it is set to 0.
+	statement->to_addr = decoded->target;
+
+	// Determine the type of branch: jump, call, return...
+	if (decoded->ret)
+		statement->br_type = RETURN; // Return
+	else if (decoded->link || after_mov_lr_pc) // this IS like a bl
+		statement->br_type = CALL; // Branch with return
+	else
+		statement->br_type = JUMP; // Definitive branch
+
+	// Determine whether the branch is conditional or not
+	if (decoded->unconditional)
+		statement->cond = UNCONDITIONAL;
+	else
+		statement->cond = CONDITIONAL;
+
+	// Determine if the branch address is computed statically
+	if (statement->to_addr != 0)
+		statement->staticity = STATIC;
+	else
+		statement->staticity = DYNAMIC;
+}
 
-	rp_function_set_name(&(rp->functions[function_id]), function_name);
+/**
+ * Decodes the instruction at pc, and adds the statement it gives (a branch, a
+ * word read by a load, or a system call), if any, to the rebuilt_program. The
+ * statement is also returned, with type OTHER if there is none. Returns the
+ * instruction.
+ */
+static inline uint32_t decompile_instruction(struct vm_program *program,
+	struct rebuilt_program *rp, vmptr_t pc, uint32_t instr_prev,
+	struct statement *statement)
+{
+	struct arm_instr_decoded decoded;
+
+	statement->type = OTHER;
+	statement->br_type = 0;
+	statement->to_addr = 0;
+	statement->to_function = -1;
+	statement->cond = 0;
+	statement->staticity = 0;
+	statement->value = 0;
+
+	arm_instr_decode(pc, vm_read_instruction(program, pc), &decoded);
+	// BLX(1) is a BL to a Thumb instruction,
+	// which does not exist in ARMv5.
+	if (decoded.type == ARM_INSTR_UNSUPPORTED)
+		FATAL_ERROR("BLX(1) instruction");
+
+	if (decoded.type == ARM_INSTR_BRANCH) {
+		decompile_branch_statement(statement, pc, &decoded,
+			instr_prev == 0xe1a0e00f); // mov lr, pc
+		statements_append(&(rp->statements), statement);
+	} else if (decoded.type == ARM_INSTR_LOAD_STORE_STATIC) {
+		// TODO: what if negative immediate?
+		statement->type = WORD;
+		statement->addr = decoded.target;
+		statement->value = vm_read_instruction(program, statement->addr);
+		if (hashset_add(rp->words, statement->addr))
+			statements_append(&(rp->statements), statement);
+		// Mark the word as explored. If it is not aligned, this is
+		// the word of the next instruction that would read it.
+		bitmap_set(rp->explored_map, (statement->addr + 3) & ~3);
+	} else if (decoded.type == ARM_INSTR_SOFTWARE_INTERRUPT) {
+		statement->type = SYSCALL;
+		statement->addr = pc;
+		statement->value = decompile_syscall_number(program, pc);
+		statements_append(&(rp->statements), statement);
+	}
+
+	return decoded.instr;
 }
 
 /**
@@ -51,21 +169,30 @@ static void decompile_set_function_name(struct vm_program *program,
  * one, looks for "function calls", "returns" and other branches, and add
  * entries in the rebuilt_program's list of branches. Theses entries will later
  * be used to determine addresses of functions.
+ * If skippable words are given (known to be neither branches, loads nor
+ * syscalls, cf. scanner.h), they are skipped without being
+ * decoded. The result is exactly the same as without them.
+ * This runs in one thread: the result depends on the order of the walks, as
+ * words read by loads stop the walks that reach them later, and instr_prev
+ * ("mov lr, pc" before a call) carries over from one walk to the next.
  */
 static void decompile_search_branches(struct vm_program *program,
-	struct rebuilt_program *rp, vmptr_t entry_addr)
+	struct rebuilt_program *rp, struct bitmap *skippable, vmptr_t entry_addr)
 {
 	struct statement statement;
 	int i;
 
 	vmptr_t *to_explore;
+	struct bitmap *queued;
 
-	uint32_t instr, instr_prev;
-	vmptr_t pc;
+	uint32_t instr, instr_prev = 0;
+	vmptr_t pc, end;
 
 	LIST_INIT(to_explore);
+	queued = bitmap_init(program);
 
 	LIST_APPEND(to_explore, entry_addr);
+	bitmap_set(queued, entry_addr);
 
 	LIST_ITERATOR(to_explore, i) {
 		//if (group_is_in_group(rp->explored, to_explore[i]))
@@ -78,355 +205,1032 @@ static void decompile_search_branches(struct vm_program *program,
 		//printf("exploring from 0x%08x\n", (int) to_explore[i]);
 		instr = 0;
 		for (pc = to_explore[i]; ; pc += 4, instr_prev = instr) {
+			// Skip words that need not be decoded, up to an explored one
+			end = pc;
+			if (skippable != NULL)
+				end = bitmap_next_set(rp->explored_map, pc,
+					bitmap_next_clear(skippable, pc, (vmptr_t) -1));
+			if (end != pc) {
+				bitmap_set_range(rp->explored_map, pc, end);
+				instr = instr_prev = vm_read_instruction(program, end - 4);
+				pc = end;
+			}
+
 			// Check if this part of the program has already been visited,
 			// if not, mark it as visited.
-			if (group_is_in_group(rp->explored, pc))
+			if (bitmap_test_and_set(rp->explored_map, pc))
 				break;
-			group_add_interval(rp->explored, pc, pc + 4);
 
-			statement.type = OTHER;
-			statement.br_type = 0;
-			statement.to_addr = 0;
-			statement.cond = 0;
-			statement.staticity = 0;
-			statement.value = 0;
-
-			instr = vm_read_instruction(program, pc);
-			//printf("0x%08x\t0x%08x\n", (int) pc, instr);
-			// Return or nop
-			/*if (arm_instr_is_return(instr) || arm_instr_is_nop(instr)) {
-				group_add_interval(rp->explored, to_explore[i], pc + 4);
-			//	group_dump(rp->explored);
-				break;
-			// Branch
-			} else*/
-			//if (arm_instr_is_branch(instr) || arm_instr_is_return(instr)) {
-			//if (arm_instr_is_branch(instr)) {
-			if (arm_instr_is_branch(pc, instr, program, &(statement.to_addr))) {
-				//printf("0x%08x\t0x%08x\n", (int) pc, instr);
-				statement.type = BRANCH;
-				statement.addr = pc;
-				// If the branch address was computed successfully, statement.to
-				// is set to the address. Else, it is set to 0.
-
-				// Determine the type of branch: jump, call, return...
-				if (arm_instr_branch_is_return(instr)) // || arm_instr_is_nop(instr)) {
-					statement.br_type = RETURN; // Return
-				else if (arm_instr_branch_is_bl(instr)
-					|| instr_prev == 0xe1a0e00f) // mov	lr, pc: this IS like a bl
-					statement.br_type = CALL; // Branch with return
-				else
-					statement.br_type = JUMP; // Definitive branch
-
-				// Determine whether the branch is conditional or not
-				if (arm_instr_is_unconditional(instr))
-					statement.cond = UNCONDITIONAL;
-				else
-					statement.cond = CONDITIONAL;
-
-				// Determine if the branch address is computed statically...
-				/*if (arm_instr_branch_is_static(instr)) {
-					statement.staticity = STATIC;
-					statement.to = arm_instr_branch_static_get_addr(pc, instr);
-				// ... dynamically but easily...
-				} else if (arm_instr_branch_dynamic_try_get_addr(pc, instr,
-					program, &(statement.to))) {
-					statement.staticity = FALSEDYNAMIC;
-				// ... or dynamically
-				} else {
-					statement.staticity = DYNAMIC;
-				}*/
-				if (statement.to_addr != 0) {
-					//statement.staticity = FALSESTATIC;
-					statement.staticity = STATIC;
+			instr = decompile_instruction(program, rp, pc, instr_prev,
+				&statement);
+			if (statement.type != BRANCH)
+				continue;
+			if (statement.staticity == STATIC) {
+				// Don't enqueue targets that are already explored, or
+				// already waiting to be explored
+				if (!bitmap_is_set(rp->explored_map, statement.to_addr)
+					&& !bitmap_test_and_set(queued, statement.to_addr))
 					LIST_APPEND(to_explore, statement.to_addr);
-				} else {
-					statement.staticity = DYNAMIC;
-				}
-
-				LIST_APPEND(rp->statements, statement);
-
-				//if (pc == 0x138e8)
-				//	statement_dump(&statement);
-				//if (statement.staticity == STATIC) {
-				//LIST_IFNOT_CONTAINS(to_explore, statement.to)
-				//	LIST_APPEND(to_explore, statement.to);
-				//}
-				// Definitive and unconditional branch
-				if (statement.br_type == RETURN
-					|| (statement.br_type == JUMP && statement.cond == UNCONDITIONAL)) {
-					// Reached end of function, get out
-					//group_add_interval(rp->explored, to_explore[i], pc + 4);
-					break;
-				}
-			/*} else if (arm_instr_is_nop(instr)) {
-				statement.addr = pc;
-				statement.type = NOP;
-				LIST_APPEND(rp->statements, statement);*/
-				/*// Reached end of function, get out
-				group_add_interval(rp->explored, to_explore[i], pc);
-				break;*/
-			//} else if (((instr >> 20) & 0xff) == 0x59 && ((instr >> 16) & 0xf) == 15) { // load / store at immediate offset from PC
-			} else if (arm_instr_is_load_store_static(instr)) {
-				// TODO: what if negative immediate?
-				statement.type = WORD;
-				statement.addr = arm_instr_load_store_static_get_addr(instr, pc);
-				statement.value = vm_read_instruction(program, statement.addr);
-				LIST_IFNOT_CONTAINS(rp->statements, statement)
-					LIST_APPEND(rp->statements, statement);
-				group_add_interval(rp->explored, statement.addr, statement.addr + 4);
-				// This helps merging groups, and so, keeping less groups and running faster
-				// Ah bon? Pas pour l'instant, à vérifier plus tard
-				//group_add_interval(rp->explored, statement.addr, statement.addr + 4);
+			}
+			// Definitive and unconditional branch
+			if (statement.br_type == RETURN
+				|| (statement.br_type == JUMP && statement.cond == UNCONDITIONAL)) {
+				// Reached end of function, get out
+				//group_add_interval(rp->explored, to_explore[i], pc + 4);
+				break;
 			}
 		}
 	}
 
+	bitmap_free(queued);
 	LIST_FREE(to_explore);
 }
 
 /**
- * Function to compare two statements by their address.
- * This is used by the sorting algorithm.
+ * Tells if an address is in an executable section.
  */
-static int cmp_statements_addr(const void *a, const void *b)
+static int decompile_is_code(struct vm_program *program, vmptr_t addr)
 {
-	return ((struct statement *) a)->addr - ((struct statement *) b)->addr;
+	int section = vm_find_section(program, addr);
+
+	return section >= 0 && program->sections[section].executable;
 }
 
-static void decompile_search_functions(struct vm_program *program,
-	struct rebuilt_program *rp)
+/**
+ * Tells if a call statement really calls code: it must not be a word read as
+ * an instruction (e.g. by the sweep, in a literal pool), and must go to an
+ * executable section.
+ */
+static int decompile_is_code_call(struct vm_program *program,
+	struct rebuilt_program *rp, int statement)
 {
-	struct statement *s;
-	int i, j;
+	struct statements *st = &(rp->statements);
+
+	return !hashset_contains(rp->words, st->addr[statement])
+		&& decompile_is_code(program, st->to_addr[statement]);
+}
+
+/**
+ * Statements and function starts found in a chunk of code by a linear sweep.
+ */
+struct decompile_sweep_chunk {
+	struct statement *statements;
+	vmptr_t *starts;
+};
+
+struct decompile_sweep {
+	struct vm_program *program;
+	struct scanner *scanner;
+	struct decompile_sweep_chunk *chunks; // same order as the sweep's ones
+};
+
+/**
+ * Reads all instructions of a chunk of code, like decompile_search_branches()
+ * does but without following branches (cf. sweep.h). Only words that are not
+ * skippable are decoded (cf. scanner.h). Data may be read as instructions:
+ * what can not be an instruction (BLX(1), load at an invalid address, static
+ * branch out of executable sections) is ignored. Functions start at prologues.
+ */
+static void decompile_sweep_chunk(void *data, int chunk, vmptr_t start,
+	vmptr_t end)
+{
+	struct decompile_sweep *sweep = data;
+	struct decompile_sweep_chunk *found = &(sweep->chunks[chunk]);
+	struct scanner *scanner = sweep->scanner;
+	struct vm_elf_section *section;
+	struct statement statement;
+	struct arm_instr_decoded decoded;
+	uint64_t *skippable, *prologue, *mov_lr_pc, bits;
+	uint32_t *code, *word;
+	size_t first, last, i, count = 0, length;
+	int s;
+	vmptr_t pc;
+
+	// Chunks are made of whole blocks of a section (cf. sweep.h): read the
+	// bitmaps block by block
+	s = vm_find_section(sweep->program, start);
+	section = &(sweep->program->sections[s]);
+	code = section->map_addr;
+	first = (start - section->vaddr) / 4;
+	last = (end - section->vaddr) / 4;
+	skippable = scanner->skippable->sections[s].bits;
+	prologue = scanner->classes[SCANNER_PROLOGUE]->sections[s].bits;
+	mov_lr_pc = scanner->classes[SCANNER_MOV_LR_PC]->sections[s].bits;
+
+	for (i = first / 64; i < (last + 63) / 64; i++)
+		count += __builtin_popcountll(~skippable[i]);
+	LIST_INIT(found->statements);
+	LIST_RESERVE(found->statements, count);
+	LIST_INIT(found->starts);
+
+	for (i = first; i < last; i += 64)
+		for (bits = prologue[i / 64]; bits != 0; bits &= bits - 1)
+			if (i + __builtin_ctzll(bits) < last)
+				LIST_APPEND(found->starts,
+					section->vaddr + (i + __builtin_ctzll(bits)) * 4);
+
+	for (i = first; i < last; i += 64) {
+		for (bits = ~skippable[i / 64]; bits != 0; bits &= bits - 1) {
+			if (i + __builtin_ctzll(bits) >= last)
+				break;
+			pc = section->vaddr + (i + __builtin_ctzll(bits)) * 4;
+			memset(&statement, 0, sizeof(statement));
+			statement.type = OTHER;
+			statement.to_function = -1;
+
+			arm_instr_decode(pc, code[(pc - section->vaddr) / 4], &decoded);
+			if (decoded.type == ARM_INSTR_BRANCH) {
+				if (decoded.target != 0
+					&& !decompile_is_code(sweep->program, decoded.target))
+					continue;
+				decompile_branch_statement(&statement, pc, &decoded,
+					pc > section->vaddr && (mov_lr_pc[(pc - section->vaddr
+						- 4) / 256] >> ((pc - section->vaddr - 4) / 4 % 64) & 1));
+			} else if (decoded.type == ARM_INSTR_LOAD_STORE_STATIC) {
+				word = vm_get_data(sweep->program, decoded.target, &length);
+				if (word == NULL || length < 4)
+					continue;
+				statement.type = WORD;
+				statement.addr = decoded.target;
+				statement.value = *word;
+			} else if (decoded.type == ARM_INSTR_SOFTWARE_INTERRUPT) {
+				statement.type = SYSCALL;
+				statement.addr = pc;
+				statement.value = decompile_syscall_number(sweep->program, pc);
+			} else {
+				continue;
+			}
+			LIST_APPEND(found->statements, statement);
+		}
+	}
+}
+
+/**
+ * Reads all executable sections of the program with several threads, instead
+ * of following branches from the entry point. The statements found are added
+ * in address order, whatever the number of threads. Returns the sorted list of
+ * function starts: prologues, and targets of static calls in executable
+ * sections (except calls that are in fact words). The list must be freed.
+ */
+static vmptr_t *decompile_sweep(struct vm_program *program,
+	struct rebuilt_program *rp, struct scanner *scanner, int jobs)
+{
+	struct statements *st = &(rp->statements);
+	struct decompile_sweep sweep_data;
+	struct decompile_sweep_chunk *found;
+	struct sweep *sweep;
+	vmptr_t *starts;
+	int i, j, count;
+
+	sweep = sweep_init(program, jobs);
+	sweep_data.program = program;
+	sweep_data.scanner = scanner;
+	sweep_data.chunks = calloc(LIST_LENGTH(sweep->chunks),
+		sizeof(struct decompile_sweep_chunk));
+	if (sweep_data.chunks == NULL)
+		FATAL_ERROR("calloc");
+	sweep_run(sweep, decompile_sweep_chunk, &sweep_data);
+
+	count = STATEMENTS_LENGTH(st);
+	LIST_ITERATOR(sweep->chunks, i)
+		count += LIST_LENGTH(sweep_data.chunks[i].statements);
+	statements_reserve(st, count);
+
+	LIST_INIT(starts);
+	LIST_ITERATOR(sweep->chunks, i) {
+		found = &(sweep_data.chunks[i]);
+		bitmap_set_range(rp->explored_map, sweep->chunks[i].start,
+			sweep->chunks[i].end);
+		LIST_ITERATOR(found->statements, j) {
+			if (found->statements[j].type == WORD) {
+				if (!hashset_add(rp->words, found->statements[j].addr))
+					continue;
+				bitmap_set(rp->explored_map,
+					(found->statements[j].addr + 3) & ~3);
+			}
+			statements_append(st, &(found->statements[j]));
+		}
+		LIST_ITERATOR(found->starts, j)
+			LIST_APPEND(starts, found->starts[j]);
+		LIST_FREE(found->statements);
+		LIST_FREE(found->starts);
+	}
+	free(sweep_data.chunks);
+	sweep_free(sweep);
+
+	LIST_ITERATOR(st->addr, i)
+		if (STATEMENT_GET_TYPE(st->flags[i]) == BRANCH
+			&& STATEMENT_GET_BR_TYPE(st->flags[i]) == CALL
+			&& st->to_addr[i] != 0
+			&& decompile_is_code_call(program, rp, i))
+			LIST_APPEND(starts, st->to_addr[i]);
+
+	// Sort and remove duplicates
+	radix_sort(starts, sizeof(vmptr_t), LIST_LENGTH(starts), 0);
+	for (i = 0, j = 0; i < LIST_LENGTH(starts); i++)
+		if (j == 0 || starts[j - 1] != starts[i])
+			starts[j++] = starts[i];
+	LIST_LENGTH(starts) = j;
+
+	return starts;
+}
+
+/**
+ * Returns the index of the first statement at or after a given address, by
+ * binary search in the sorted addresses of statements.
+ */
+static int decompile_first_statement(vmptr_t *addrs, vmptr_t addr)
+{
+	int low = 0, high = LIST_LENGTH(addrs), middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (addrs[middle] < addr)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+/**
+ * Returns the function starting at an address, after adding it if there is
+ * none.
+ */
+static int decompile_get_function(struct vm_program *program,
+	struct rebuilt_program *rp, vmptr_t addr)
+{
+	int f_id;
+
+	f_id = rp_get_function_by_vaddr(rp, addr);
+	if (f_id == -1) {
+		f_id = rp_add_function(rp, addr);
+		decompile_set_function_name(program, rp, f_id, addr);
+		//printf("adding f%d starting at 0x%08x\n", f_id, (int) addr);
+	}
+
+	return f_id;
+}
+
+/**
+ * Returns functions [first, last) sorted by start address: work is shared
+ * between threads by ranges of addresses. The list must be freed.
+ */
+static struct function_start *decompile_sort_functions(
+	struct rebuilt_program *rp, int first, int last)
+{
+	struct function_start *starts, start;
+	int i;
+
+	LIST_INIT(starts);
+	LIST_RESERVE(starts, last - first);
+	for (i = first; i < last; i++) {
+		start.addr = rp->functions[i].vaddr_start;
+		start.id = i;
+		LIST_APPEND(starts, start);
+	}
+	radix_sort(starts, sizeof(*starts), LIST_LENGTH(starts),
+		offsetof(struct function_start, addr));
+
+	return starts;
+}
+
+/**
+ * Returns the number of functions or items given at once to a thread.
+ */
+static int decompile_range_size(int count, int jobs)
+{
+	int size = count / (jobs * DECOMPILE_RANGES_PER_JOB);
+
+	return size > DECOMPILE_RANGE_MIN_SIZE ? size : DECOMPILE_RANGE_MIN_SIZE;
+}
+
+/**
+ * A call found while reading a function, to be linked to the called function.
+ */
+struct decompile_callee {
+	int statement;
+	vmptr_t addr;
+};
+
+/**
+ * What was found by reading the statements of a function.
+ */
+struct decompile_read {
+	int first, last; // statements read: [first, last)
+	int range; // range of functions it was read with
+	int callees, callees_count; // calls, in the list of the range
+	int tail_jump; // statement of the jump to another function, or -1
+	vmptr_t min_end; // the function goes at least up to there
+};
+
+/**
+ * Functions read in a round of decompile_search_functions().
+ */
+struct decompile_round {
+	struct rebuilt_program *rp;
+	struct function_start *functions; // functions to read, by address
+	int first_id; // id of the first function to read
+	struct decompile_read *reads; // by function id, from first_id
+	struct decompile_callee **callees; // one list per range of functions
+	int range_size;
+};
+
+/**
+ * Reads the statements of a function from its start, to find its end, its
+ * calls, and the jump to another function ending it if any. Only the end is
+ * set in the function: calls and jump are returned, for
+ * decompile_link_function() to find or add the functions they go to.
+ * This does not depend on other functions: functions can be read in any order,
+ * by several threads at the same time.
+ */
+static void decompile_read_function(struct rebuilt_program *rp, int f_id,
+	struct decompile_read *read, struct decompile_callee **callees)
+{
+	struct statements *st = &(rp->statements);
+	struct decompile_callee callee;
+	int i, j, type, br_type;
+	vmptr_t addr, to_addr;
 
-	int f_id, f2_id;
 	vmptr_t f_end;
 
-	if (LIST_LENGTH(rp->statements) == 0)
-		return;
+	// Find the first branch of the function: j
+	j = decompile_first_statement(st->addr, rp->functions[f_id].vaddr_start);
+	read->first = j;
+	read->callees = LIST_LENGTH(*callees);
+	read->tail_jump = -1;
+	// 1st pass: find the end of the function
+	f_end = 0;
+	for (i = j; i < STATEMENTS_LENGTH(st); i++) {
+		addr = st->addr[i];
+		type = STATEMENT_GET_TYPE(st->flags[i]);
+		br_type = STATEMENT_GET_BR_TYPE(st->flags[i]);
+		to_addr = st->to_addr[i];
+		if (type == NOP || type == WORD) {
+			if (f_end <= addr + 4) {
+				rp->functions[f_id].vaddr_end = addr;
+				break;
+			}
+			continue;
+		}
+		if (type == SYSCALL)
+			continue;
+		if (br_type == RETURN) {
+			if (f_end <= addr + 4) {
+				// We've found the return point
+				rp->functions[f_id].vaddr_end = addr + 4;
+				break;
+			}
+		} else if (br_type == JUMP
+			&& STATEMENT_GET_COND(st->flags[i]) == UNCONDITIONAL) {
+			if (f_end <= addr + 4) {
+				// We've found the return point
+				rp->functions[f_id].vaddr_end = addr + 4;
+				// And add the called function to the list
+				// We have an address, may it be static or dynamic...
+				if (to_addr != 0
+					// ... and make sure we don't loop into the function
+					&& (to_addr < rp->functions[f_id].vaddr_start
+						|| to_addr >= addr + 4))
+					read->tail_jump = i;
+				break;
+			}
+		} else if (br_type == JUMP && to_addr != 0) {
+			// End of the function is AT LEAST beyond this point
+			f_end = (f_end > to_addr + 4 ? f_end : to_addr + 4);
+		} else if (br_type == CALL && to_addr != 0) {
+			// This is a call to a child function
+			callee.statement = i;
+			callee.addr = to_addr;
+			LIST_APPEND(*callees, callee);
+		}
+	}
+	read->last = i < STATEMENTS_LENGTH(st) ? i + 1 : i;
+	read->min_end = f_end;
+	read->callees_count = LIST_LENGTH(*callees) - read->callees;
+}
 
-	// Step 1: sort statements by address
-	merge_sort(rp->statements, sizeof(*rp->statements),
-		LIST_LENGTH(rp->statements), cmp_statements_addr);
+static void decompile_read_functions(void *data, int first, int last)
+{
+	struct decompile_round *round = data;
+	struct decompile_callee **callees;
+	struct decompile_read *read;
+	int i, range = first / round->range_size;
+
+	callees = &(round->callees[range]);
+	LIST_INIT(*callees);
+	for (i = first; i < last; i++) {
+		read = &(round->reads[round->functions[i].id - round->first_id]);
+		read->range = range;
+		decompile_read_function(round->rp, round->functions[i].id, read,
+			callees);
+	}
+}
 
+/**
+ * Links what was found by reading a function: the statements it read point to
+ * the functions they call, and the function to the one it jumps to. Functions
+ * that do not exist yet are added. Calls that do not call code (cf.
+ * decompile_is_code_call) are left unlinked.
+ * Overlapping functions share statements: the last function linked wins, as
+ * when they were read one after another.
+ */
+static void decompile_link_function(struct vm_program *program,
+	struct rebuilt_program *rp, int f_id, struct decompile_read *read,
+	struct decompile_callee *callees)
+{
+	struct statements *st = &(rp->statements);
+	int i;
+
+	for (i = read->first; i < read->last; i++)
+		st->to_function[i] = -1;
+	for (i = read->callees; i < read->callees + read->callees_count; i++)
+		if (decompile_is_code_call(program, rp, callees[i].statement))
+			st->to_function[callees[i].statement] = decompile_get_function(
+				program, rp, callees[i].addr);
+	if (read->tail_jump != -1) {
+		// Other functions may share this statement
+		rp->functions[f_id].tail_jump = st->addr[read->tail_jump];
+		rp->functions[f_id].tail_function = decompile_get_function(program,
+			rp, st->to_addr[read->tail_jump]);
+	}
+}
+
+/**
+ * Reads functions [first, last) with several threads, by ranges of addresses.
+ * Then links them one after another, by id: functions are added in the same
+ * order as if they were read and linked one after another, whatever the
+ * number of threads.
+ */
+static void decompile_read_round(struct vm_program *program,
+	struct rebuilt_program *rp, int first, int last, int jobs)
+{
+	struct decompile_round round;
+	int i, ranges;
+
+	round.rp = rp;
+	round.functions = decompile_sort_functions(rp, first, last);
+	round.first_id = first;
+	round.range_size = decompile_range_size(last - first, jobs);
+	ranges = (last - first + round.range_size - 1) / round.range_size;
+	round.reads = calloc(last - first, sizeof(struct decompile_read));
+	round.callees = calloc(ranges, sizeof(struct decompile_callee *));
+	if (round.reads == NULL || round.callees == NULL)
+		FATAL_ERROR("calloc");
+
+	workers_run(jobs, last - first, round.range_size,
+		decompile_read_functions, &round);
+
+	for (i = first; i < last; i++)
+		decompile_link_function(program, rp, i, &(round.reads[i - first]),
+			round.callees[round.reads[i - first].range]);
+
+	for (i = 0; i < ranges; i++)
+		LIST_FREE(round.callees[i]);
+	free(round.callees);
+	free(round.reads);
+	LIST_FREE(round.functions);
+}
+
+/**
+ * Sorts statements by address. When an address holds both a word and an
+ * instruction, the word is put first: it marks the end of a function. If the
+ * instruction is a system call, it is in fact data: it is removed.
+ */
+static void decompile_sort_statements(struct statements *st)
+{
+	int i, type;
+
+	statements_sort(st);
+
+	for (i = 1; i < STATEMENTS_LENGTH(st); i++) {
+		if (st->addr[i - 1] != st->addr[i])
+			continue;
+		type = STATEMENT_GET_TYPE(st->flags[i]);
+		if ((type == NOP || type == WORD)
+			&& STATEMENT_GET_TYPE(st->flags[i - 1]) != NOP
+			&& STATEMENT_GET_TYPE(st->flags[i - 1]) != WORD)
+			statements_swap(st, i - 1, i);
+		if (STATEMENT_GET_TYPE(st->flags[i - 1]) == WORD
+			&& STATEMENT_GET_TYPE(st->flags[i]) == SYSCALL) {
+			statements_remove(st, i);
+			i--;
+			continue;
+		}
 #if defined(DEBUG)
-	LIST_ITERATOR(rp->statements, i)
-		if (i > 0 && rp->statements[i - 1].addr == rp->statements[i].addr)
-			printf("DEBUG: statement at 0x%x exists more than once\n",
-				(int) rp->statements[i].addr);
+		printf("DEBUG: statement at 0x%x exists more than once\n",
+			(int) st->addr[i]);
 #endif
+	}
+}
+
+/**
+ * Finds the functions and their ends, from the statements: the first function
+ * starts at the entry point, the other ones are found through calls and
+ * jumps. Other starts of functions can be given (or NULL).
+ * Functions are read in rounds, each one by several threads: the functions
+ * found by a round are read by the next one.
+ */
+static void decompile_search_functions(struct vm_program *program,
+	struct rebuilt_program *rp, vmptr_t *starts, int jobs)
+{
+	struct statements *st = &(rp->statements);
+	int i, first, last;
+	int f_id;
+
+	if (STATEMENTS_LENGTH(st) == 0)
+		return;
+
+	// Step 1: sort statements by address
+	decompile_sort_statements(st);
 
 	// Step 2: add the first function
-	s = &(rp->statements[0]);
-	f_id = rp_add_function(rp);
-	s->to_function = f_id;
-	rp->functions[f_id].vaddr_start = s->to_addr;
-	decompile_set_function_name(program, rp, f_id, s->to_addr);
+	f_id = rp_add_function(rp, st->to_addr[0]);
+	st->to_function[0] = f_id;
+	decompile_set_function_name(program, rp, f_id, st->to_addr[0]);
 	//printf("adding f%d starting at 0x%08x\n", f_id, (int) rp->functions[f_id].vaddr_start);
+	if (starts != NULL) {
+		LIST_ITERATOR(starts, i) {
+			if (rp_get_function_by_vaddr(rp, starts[i]) != -1)
+				continue;
+			f_id = rp_add_function(rp, starts[i]);
+			decompile_set_function_name(program, rp, f_id, starts[i]);
+		}
+	}
 
 	// Step 3: read statements for each function
-	LIST_ITERATOR(rp->functions, f_id) {
-		// Find the first branch of the function: j
-		for (j = 0; rp->statements[j].addr < rp->functions[f_id].vaddr_start
-			&& j < LIST_LENGTH(rp->statements); j++) ;
-		// 1st pass: find the end of the function
-		f_end = 0;
-		for (i = j; i < LIST_LENGTH(rp->statements); i++) {
-			s = &(rp->statements[i]);
-			s->to_function = -1;
-			/*if (s->addr >= 0x13a10 && s->addr < 0x13a80)
-				printf("0x%08x     fend = %x\n", s->addr, f_end);*/
-			//if (s->addr == 0x8bb0 || s->addr == 0x8c30 || s->to == 0x8c30 || s->addr == 0x8dcc || s->to == 0x8dcc || s->addr == 0x8e30 || s->to == 0x8e30) {
-			/*if (b->addr >= 0x12d00 && s->addr < 0x12fb0) {
-				printf("f_end = %x\t", f_end);
-				branch_dump(s);
-			}//*/
-			if (s->type == NOP || s->type == WORD) {
-				if (f_end <= s->addr + 4) {
-					rp->functions[f_id].vaddr_end = s->addr;
-					break;
-				}
-				continue;
-			}
-			if (s->br_type == RETURN) {
-				rp_function_add_statement(&(rp->functions[f_id]), s);
-				if (f_end <= s->addr + 4) {
-					// We've found the return point
-					//printf("in f%d:\treturn point found at 0x%08x\n", f_id, s->addr);
-					rp->functions[f_id].vaddr_end = s->addr + 4;
-					break;
-				}
-			} else if (s->br_type == JUMP && s->cond == UNCONDITIONAL) {
-				if (f_end <= s->addr + 4) {
-					// We've found the return point
-					//printf("in f%d:\treturn point found at 0x%08x\n", f_id, s->addr);
-					rp->functions[f_id].vaddr_end = s->addr + 4;
-					// And add the called function to the list
-					//if (s->staticity == STATIC
-					// We have an address, may it be static or dynamic...
-					if (s->to_addr != 0
-						// ... and make sure we don't loop into the function
-						&& (s->to_addr < rp->functions[f_id].vaddr_start
-							|| s->to_addr >= s->addr + 4)) {
-						f2_id = rp_get_function_by_vaddr(rp, s->to_addr);
-						if (f2_id == -1) {
-							f2_id = rp_add_function(rp);
-							rp->functions[f2_id].vaddr_start = s->to_addr;
-							decompile_set_function_name(program, rp, f2_id, s->to_addr);
-							//printf("in f%d:\tadding f%d starting at 0x%08x\n", f_id, f2_id, (int) rp->functions[f2_id].vaddr_start);
-						}
-						s->to_function = f2_id;
-					}
-					rp_function_add_statement(&(rp->functions[f_id]), s);
-					break;
-				}
-				rp_function_add_statement(&(rp->functions[f_id]), s);
-			//} else if (s->br_type == JUMP && s->staticity == STATIC) {
-			} else if (s->br_type == JUMP && s->to_addr != 0) {
-				// End of the function is AT LEAST beyond this point
-				f_end = (f_end > s->to_addr + 4 ? f_end : s->to_addr + 4);
-				rp_function_add_statement(&(rp->functions[f_id]), s);
-			//} else if (s->br_type == CALL && s->staticity == STATIC) {
-			} else if (s->br_type == CALL && s->to_addr != 0) {
-				// This is a call to a child function
-				f2_id = rp_get_function_by_vaddr(rp, s->to_addr);
-				if (f2_id == -1) {
-					f2_id = rp_add_function(rp);
-					rp->functions[f2_id].vaddr_start = s->to_addr;
-					decompile_set_function_name(program, rp, f2_id, s->to_addr);
-					//printf("in f%d:\tadding f%d starting at 0x%08x\n", f_id, f2_id, (int) rp->functions[f2_id].vaddr_start);
-				}
-				s->to_function = f2_id;
-				rp_function_add_statement(&(rp->functions[f_id]), s);
-			} else {
-				rp_function_add_statement(&(rp->functions[f_id]), s);
+	for (first = 0; first < LIST_LENGTH(rp->functions); first = last) {
+		last = LIST_LENGTH(rp->functions);
+		decompile_read_round(program, rp, first, last, jobs);
+	}
+}
+
+/**
+ * System calls found in a range of functions, by
+ * decompile_search_unexplored_syscalls().
+ */
+struct decompile_syscalls {
+	struct vm_program *program;
+	struct rebuilt_program *rp;
+	struct function_start *functions; // by address
+	vmptr_t **found; // one list per range of functions
+	int range_size;
+};
+
+static void decompile_search_syscalls_in_functions(void *data, int first,
+	int last)
+{
+	struct decompile_syscalls *syscalls = data;
+	struct rebuilt_program *rp = syscalls->rp;
+	struct rebuilt_function *f;
+	struct arm_instr_decoded decoded;
+	vmptr_t **found = &(syscalls->found[first / syscalls->range_size]);
+	int i;
+
+	vmptr_t pc, end;
+
+	LIST_INIT(*found);
+	for (i = first; i < last; i++) {
+		f = &(rp->functions[syscalls->functions[i].id]);
+		for (pc = f->vaddr_start; pc < f->vaddr_end; ) {
+			// Skip the explored part, then read up to the next one
+			pc = bitmap_next_clear(rp->explored_map, pc, f->vaddr_end);
+			if (pc >= f->vaddr_end)
+				break;
+			end = bitmap_next_set(rp->explored_map, pc, f->vaddr_end);
+			if (end == pc) // not in a section: the read will fail
+				end = pc + 4;
+			for (; pc < end; pc += 4) {
+				arm_instr_decode(pc,
+					vm_read_instruction(syscalls->program, pc), &decoded);
+				if (decoded.type == ARM_INSTR_SOFTWARE_INTERRUPT)
+					LIST_APPEND(*found, pc);
 			}
 		}
 	}
 }
 
 /**
- * Reads each rebuilt function instruction, in order to find ones that are
- * system calls.
+ * System calls in explored code are found by decompile_search_branches(). This
+ * looks for the ones in parts of functions that were not explored (e.g. code
+ * only reached by dynamic branches), and adds them to the statements.
+ * Functions are shared between threads by ranges of addresses.
  */
-static void decompile_search_syscalls(struct vm_program *program,
-	struct rebuilt_program *rp)
+static void decompile_search_unexplored_syscalls(struct vm_program *program,
+	struct rebuilt_program *rp, int jobs)
 {
-	int f_id;
+	struct decompile_syscalls syscalls;
+	struct statement s;
+	struct hashset *found;
+	int i, j, ranges, functions = LIST_LENGTH(rp->functions);
 
-	uint32_t instr, instr2;
-	vmptr_t pc;
+	if (functions == 0)
+		return;
 
-	struct statement s;
+	syscalls.program = program;
+	syscalls.rp = rp;
+	syscalls.functions = decompile_sort_functions(rp, 0, functions);
+	syscalls.range_size = decompile_range_size(functions, jobs);
+	ranges = (functions + syscalls.range_size - 1) / syscalls.range_size;
+	syscalls.found = calloc(ranges, sizeof(vmptr_t *));
+	if (syscalls.found == NULL)
+		FATAL_ERROR("calloc");
+
+	workers_run(jobs, functions, syscalls.range_size,
+		decompile_search_syscalls_in_functions, &syscalls);
 
+	memset(&s, 0, sizeof(s));
 	s.type = SYSCALL;
+	s.to_function = -1;
+	found = hashset_init();
+
+	// Functions may overlap: keep each system call once
+	for (i = 0; i < ranges; i++) {
+		LIST_ITERATOR(syscalls.found[i], j) {
+			if (!hashset_add(found, syscalls.found[i][j]))
+				continue;
+			s.addr = syscalls.found[i][j];
+			s.value = decompile_syscall_number(program, s.addr);
+			statements_append(&(rp->statements), &s);
+		}
+		LIST_FREE(syscalls.found[i]);
+	}
+	free(syscalls.found);
+	LIST_FREE(syscalls.functions);
+
+	// Put them in place. The sort is stable: statements already sorted keep
+	// their order.
+	if (found->count > 0)
+		statements_sort(&(rp->statements));
+	hashset_free(found);
+}
+
+/**
+ * Sets the span of statements of each function: the ones from its start to its
+ * end. A function whose end was not found goes up to the last statement.
+ */
+static void decompile_set_functions_statements(struct rebuilt_program *rp)
+{
+	struct rebuilt_function *f;
+	int f_id, last;
 
 	LIST_ITERATOR(rp->functions, f_id) {
-		// For each function, read the code and search for system calls
-		for (pc = rp->functions[f_id].vaddr_start;
-			pc < rp->functions[f_id].vaddr_end; pc += 4) {
-			instr = vm_read_instruction(program, pc);
-			if (arm_instr_is_software_interrupt(instr)) {
-				s.addr = pc;
-				// Read the previous instruction to know what it really is
-				instr2 = vm_read_instruction(program, pc - 4);
-				if ((instr2 & 0xfffff000) != 0xe3a07000)
-					instr2 = vm_read_instruction(program, pc - 8);
-				if ((instr2 & 0xfffff000) == 0xe3a07000) // mov r7, #val
-					s.value = arm_instr_mov_r7_immediate_get_value(instr2);
-				else
-					s.value = -1;
-				rp_function_add_statement(&(rp->functions[f_id]), &s);
-			}
+		f = &(rp->functions[f_id]);
+		f->first_statement = decompile_first_statement(rp->statements.addr,
+			f->vaddr_start);
+		if (f->vaddr_end == 0)
+			last = STATEMENTS_LENGTH(&(rp->statements));
+		else
+			last = decompile_first_statement(rp->statements.addr,
+				f->vaddr_end);
+		f->statements_count = last > f->first_statement ?
+			last - f->first_statement : 0;
+	}
+}
+
+/**
+ * If the binary was compiled with the standard library, main() is not called
+ * directly. The program starts with glibc's _start(), whose first branch calls
+ * __libc_start_main(), which calls main() at a known place. The address of
+ * main() is stored in the 2nd word at the end of _start().
+ * Returns the index of the statement calling main(), or -1 if the program was
+ * not compiled with the standard library. Statements can be in any order.
+ */
+static int decompile_find_call_to_main(struct vm_program *program,
+	struct rebuilt_program *rp, vmptr_t *main_function)
+{
+	struct statements *st = &(rp->statements);
+	vmptr_t entry = st->to_addr[0], libc_start_main;
+	int i, first = -1;
+
+	// Detect the typical glibc first function, _start
+	for (i = 1; i < STATEMENTS_LENGTH(st); i++)
+		if (STATEMENT_GET_TYPE(st->flags[i]) == BRANCH
+			&& st->addr[i] >= entry
+			&& (first == -1 || st->addr[i] < st->addr[first]))
+			first = i;
+	if (first == -1 || st->addr[first] != entry + 0x28
+		|| STATEMENT_GET_BR_TYPE(st->flags[first]) != CALL
+		|| STATEMENT_GET_COND(st->flags[first]) != UNCONDITIONAL)
+		return -1;
+	libc_start_main = st->to_addr[first];
+
+	LIST_ITERATOR(st->addr, i) {
+		if (STATEMENT_GET_TYPE(st->flags[i]) == BRANCH
+			&& STATEMENT_GET_BR_TYPE(st->flags[i]) == CALL
+			&& STATEMENT_GET_COND(st->flags[i]) == UNCONDITIONAL
+			&& st->addr[i] == libc_start_main + 0x1a8) {
+			*main_function = vm_read_instruction(program, 0x8184);
+			return i;
 		}
-		// There is a need to re-sort the statements...
-		merge_sort(rp->functions[f_id].statements,
-			sizeof(*rp->functions[f_id].statements),
-			LIST_LENGTH(rp->functions[f_id].statements), cmp_statements_addr);
 	}
+
+	return -1;
+}
+
+/**
+ * Marks with a value the functions reached from a function through calls and
+ * jumps, except the ones already marked and the stop one (or -1).
+ */
+static void decompile_reach_functions(struct rebuilt_program *rp, int f_id,
+	uint8_t *reached, uint8_t value, int stop_id)
+{
+	struct rebuilt_function *f;
+	int *to_visit;
+	int i, j;
+
+	LIST_INIT(to_visit);
+	LIST_APPEND(to_visit, f_id);
+	reached[f_id] = value;
+	LIST_ITERATOR(to_visit, i) {
+		f = &(rp->functions[to_visit[i]]);
+		RP_FUNCTION_ITERATOR(rp, f, j) {
+			if (STATEMENT_GET_TYPE(rp->statements.flags[j]) != BRANCH)
+				continue;
+			f_id = rp_statement_to_function(rp, f, j);
+			if (f_id == -1 || f_id == stop_id || reached[f_id] != 0)
+				continue;
+			reached[f_id] = value;
+			LIST_APPEND(to_visit, f_id);
+		}
+	}
+	LIST_FREE(to_visit);
+}
+
+/**
+ * Marks functions as "stdlib" functions, after a linear sweep. When following
+ * branches, these are the functions found before exploring from main(), and
+ * the other ones are found from main(). A linear sweep finds all functions at
+ * once: the same sets are found through the calls between functions. The
+ * functions found in neither way (never called, or data read as code) are
+ * considered part of the standard library too.
+ */
+static void decompile_mark_stdlib_functions(struct rebuilt_program *rp,
+	vmptr_t main_function)
+{
+	uint8_t *reached;
+	int i, main_id;
+
+	reached = calloc(LIST_LENGTH(rp->functions), sizeof(uint8_t));
+	if (reached == NULL)
+		FATAL_ERROR("calloc");
+
+	main_id = rp_get_function_by_vaddr(rp, main_function);
+	decompile_reach_functions(rp, 0, reached, 1, main_id);
+	if (main_id != -1 && reached[main_id] == 0)
+		decompile_reach_functions(rp, main_id, reached, 2, -1);
+
+	LIST_ITERATOR(rp->functions, i)
+		rp->functions[i].from_stdlib = reached[i] != 2;
+	free(reached);
 }
 
 /**
  * Starts the decompilation of the source binary.
+ * In MODE_RECURSIVE, instructions are read by following branches from the
+ * entry point. Executable sections are first classified by a scanner (cf.
+ * scanner.h), which tells which words need not be decoded.
+ * In MODE_SWEEP, all executable sections are read linearly by jobs threads
+ * (cf. sweep.h): this also finds code that is only reached by dynamic
+ * branches, and functions that are never called (but also reads data as
+ * code).
+ * In both modes, functions are then read and searched for system calls by jobs
+ * threads (cf. workers.h).
  */
-int decompile(struct vm_program *program, struct rebuilt_program *rp)
+int decompile(struct vm_program *program, struct rebuilt_program *rp,
+	int mode, int jobs)
 {
+	struct statements *st = &(rp->statements);
 	struct statement s;
-	int i, j;
+	int i;
 
-	int contains_stdlib;
 	int call_to_main;
-	vmptr_t libc_start_main;
-	vmptr_t main_function;
-	vmptr_t *stdlib_addrs;
+	vmptr_t main_function = 0;
+	struct hashset *stdlib_addrs = NULL;
+	struct scanner *scanner = NULL;
+	struct bitmap *skippable;
+	vmptr_t *starts = NULL;
+
+	rp->explored_map = bitmap_init(program);
+	rp->words = hashset_init();
+	rp->strings = program->strings;
 
 	// Decompile from the entry point of the program
+	memset(&s, 0, sizeof(s));
 	s.addr = 0;
 	s.type = BRANCH;
 	s.to_addr = program->entrypoint;
 	s.br_type = JUMP;
-	LIST_APPEND(rp->statements, s);
-	decompile_search_branches(program, rp, s.to_addr);
-
-	// If the binary was compiled with standard library, main() is not called
-	// directly. We need to the find its address, which is stored in the 2nd
-	// word at the end of _start() function.
-	// First, detect if the program was compiled with the standard library.
-	contains_stdlib = 0;
-	j = 0;
-	LIST_ITERATOR(rp->statements, i) {
-		if (rp->statements[i].type == BRANCH) {
-			// Detect the typical glibc first function, _start
-			if (j == 1 && rp->statements[i].br_type == CALL
-				&& rp->statements[i].cond == UNCONDITIONAL
-				&& rp->statements[i].addr == rp->statements[0].to_addr + 0x28) {
-				libc_start_main = rp->statements[i].to_addr;
-				main_function = vm_read_instruction(program, 0x8184);
-				contains_stdlib = 1;
-			//} else if (j > 1) {
-			//	break;
-			} else if (rp->statements[i].br_type == CALL
-				&& rp->statements[i].cond == UNCONDITIONAL
-				&& rp->statements[i].addr == libc_start_main + 0x1a8) {
-					call_to_main = i;
-					break;
-			}
-			j++;
-		}
+	statements_append(&(rp->statements), &s);
+	if (mode == MODE_SWEEP) {
+		scanner = scanner_init(program);
+		starts = decompile_sweep(program, rp, scanner, jobs);
+		skippable = NULL;
+	} else {
+		scanner = scanner_init(program);
+		skippable = scanner->skippable;
 	}
+	if (mode == MODE_RECURSIVE)
+		decompile_search_branches(program, rp, skippable, s.to_addr);
 
 	// Step 1/2 of marking stdlib functions as "stdlib" functions
-	if (contains_stdlib) {
-		LIST_INIT(stdlib_addrs);
+	call_to_main = decompile_find_call_to_main(program, rp, &main_function);
+	if (call_to_main != -1 && mode == MODE_RECURSIVE) {
+		stdlib_addrs = hashset_init();
 
 		// Add all current functions to the stdlib functions list
-		LIST_ITERATOR(rp->statements, i)
-			if (rp->statements[i].to_addr != 0)
-				LIST_APPEND(stdlib_addrs, rp->statements[i].to_addr);
+		LIST_ITERATOR(st->to_addr, i)
+			if (st->to_addr[i] != 0)
+				hashset_add(stdlib_addrs, st->to_addr[i]);
 		
 		// And start exploring from main()
-		rp->statements[call_to_main].to_addr = main_function;
-		decompile_search_branches(program, rp, main_function);
+		st->to_addr[call_to_main] = main_function;
+		decompile_search_branches(program, rp, skippable, main_function);
+	} else if (call_to_main != -1) {
+		// main() was already read, link it to its call
+		st->to_addr[call_to_main] = main_function;
 	}
 
-	// Find functions addresses and stop points using all the branches we have
-	decompile_search_functions(program, rp);
+	if (scanner != NULL)
+		scanner_free(scanner);
+
+	// Keep the explored ranges for those who need them
+	bitmap_to_group(rp->explored_map, rp->explored);
+
+	// Find functions addresses and stop points using all the branches (and
+	// system calls) we have
+	decompile_search_functions(program, rp, starts, jobs);
+	if (starts != NULL)
+		LIST_FREE(starts);
 
 	// Step 2/2 of marking stdlib functions as "stdlib" functions
-	if (contains_stdlib) {
-		LIST_ITERATOR(rp->functions, i) {
-			LIST_IF_CONTAINS(stdlib_addrs, rp->functions[i].vaddr_start)
+	if (stdlib_addrs != NULL) {
+		LIST_ITERATOR(rp->functions, i)
+			if (hashset_contains(stdlib_addrs, rp->functions[i].vaddr_start))
 				rp->functions[i].from_stdlib = 1;
-		}
 
-		LIST_FREE(stdlib_addrs);
+		hashset_free(stdlib_addrs);
 	}
 
-	decompile_search_syscalls(program, rp);
+	decompile_search_unexplored_syscalls(program, rp, jobs);
+	decompile_set_functions_statements(rp);
 
 	//rp_check_overlapping_functions(rp);
 	rp_fix_overlapping_functions(rp);
 
+	if (call_to_main != -1 && mode == MODE_SWEEP)
+		decompile_mark_stdlib_functions(rp, main_function);
+
 	return 0;
 }
+
+/**
+ * Adds an address to a min-heap of addresses.
+ */
+static void decompile_heap_push(vmptr_t **heap, vmptr_t addr)
+{
+	vmptr_t *h;
+	int i;
+
+	LIST_APPEND(*heap, addr);
+	h = *heap;
+	for (i = LIST_LENGTH(h) - 1; i > 0 && h[(i - 1) / 2] > addr;
+		i = (i - 1) / 2)
+		h[i] = h[(i - 1) / 2];
+	h[i] = addr;
+}
+
+/**
+ * Removes the lowest address from a non-empty min-heap of addresses.
+ */
+static void decompile_heap_pop(vmptr_t *heap)
+{
+	vmptr_t last = heap[--LIST_LENGTH(heap)];
+	int i = 0, child;
+
+	while ((child = 2 * i + 1) < LIST_LENGTH(heap)) {
+		if (child + 1 < LIST_LENGTH(heap) && heap[child + 1] < heap[child])
+			child++;
+		if (heap[child] >= last)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	if (LIST_LENGTH(heap) > 0)
+		heap[i] = last;
+}
+
+/**
+ * Explores a function from its start, following the jumps inside it but not
+ * its calls (cf. decompile_search_branches()). Code is explored in increasing
+ * order of addresses (jump targets wait in a min-heap), and only until the end
+ * of the function is known: once all code left to explore is beyond the end
+ * found in the statements read so far, it can not change it.
+ * The statements are only sorted and read again when no code is left to
+ * explore before the end found last time (or, if none was found, before the
+ * farthest jump target), so that a function with many jump targets is not read
+ * again after each of them.
+ */
+static void decompile_explore_function(struct vm_program *program,
+	struct rebuilt_program *rp, int f_id,
+	struct decompile_read *read, struct decompile_callee **callees)
+{
+	struct statement statement;
+	vmptr_t start = rp->functions[f_id].vaddr_start;
+	vmptr_t *to_explore, pc, end = 0, known_end = 0;
+	uint32_t instr, instr_prev;
+
+	LIST_INIT(to_explore);
+	decompile_heap_push(&to_explore, start);
+	while (LIST_LENGTH(to_explore) > 0) {
+		// Explore from the lowest address waiting
+		pc = to_explore[0];
+		decompile_heap_pop(to_explore);
+
+		for (instr = instr_prev = 0;
+			!bitmap_test_and_set(rp->explored_map, pc);
+			pc += 4, instr_prev = instr) {
+			instr = decompile_instruction(program, rp, pc, instr_prev,
+				&statement);
+			if (statement.type != BRANCH)
+				continue;
+			// Code before the start is not part of the function
+			if (statement.staticity == STATIC && statement.br_type == JUMP
+				&& statement.to_addr >= start
+				&& !bitmap_is_set(rp->explored_map, statement.to_addr))
+				decompile_heap_push(&to_explore, statement.to_addr);
+			if (statement.br_type == RETURN
+				|| (statement.br_type == JUMP && statement.cond == UNCONDITIONAL))
+				break;
+		}
+
+		// Forget the targets explored since they were added
+		while (LIST_LENGTH(to_explore) > 0
+			&& bitmap_is_set(rp->explored_map, to_explore[0]))
+			decompile_heap_pop(to_explore);
+		if (LIST_LENGTH(to_explore) > 0 && to_explore[0] < known_end)
+			continue;
+
+		// Find the end with the statements read so far
+		statements_sort(&(rp->statements));
+		rp->functions[f_id].vaddr_end = 0;
+		LIST_LENGTH(*callees) = 0;
+		decompile_read_function(rp, f_id, read, callees);
+		end = rp->functions[f_id].vaddr_end;
+		if (end != 0 && (LIST_LENGTH(to_explore) == 0 || to_explore[0] >= end))
+			break;
+		known_end = end != 0 ? end : read->min_end;
+	}
+
+	LIST_FREE(to_explore);
+}
+
+/**
+ * Decompiles only the function starting at an address, for queries about this
+ * function alone: its time depends on the size of the function, not of the
+ * program. The functions it calls are added with their names, but are not
+ * read. Functions without symbols are numbered in the order they are found,
+ * so not as by decompile(), and none is marked as part of the standard
+ * library.
+ * Returns the id of the function, or -1 if the address is not in code.
+ */
+int decompile_function(struct vm_program *program, struct rebuilt_program *rp,
+	vmptr_t addr)
+{
+	struct decompile_callee *callees;
+	struct decompile_read read;
+	int section, f_id;
+
+	section = vm_find_section(program, addr);
+	if (section == -1 || !program->sections[section].executable
+		|| addr % 4 != 0)
+		return -1;
+
+	rp->explored_map = bitmap_init(program);
+	rp->words = hashset_init();
+	rp->strings = program->strings;
+
+	f_id = rp_add_function(rp, addr);
+	decompile_set_function_name(program, rp, f_id, addr);
+
+	LIST_INIT(callees);
+	decompile_explore_function(program, rp, f_id, &read, &callees);
+
+	// Read it again with words before instructions at the same address, as
+	// decompile() does: this can only move its end back
+	decompile_sort_statements(&(rp->statements));
+	rp->functions[f_id].vaddr_end = 0;
+	LIST_LENGTH(callees) = 0;
+	decompile_read_function(rp, f_id, &read, &callees);
+	decompile_link_function(program, rp, f_id, &read, callees);
+	LIST_FREE(callees);
+
+	bitmap_to_group(rp->explored_map, rp->explored);
+
+	decompile_search_unexplored_syscalls(program, rp, 1);
+	decompile_set_functions_statements(rp);
+	rp_fix_overlapping_functions(rp);
+
+	return f_id;
+}
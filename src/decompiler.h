@@ -36,7 +36,11 @@
 #include "vm.h"
 
 enum { STDLIB_SHOW, STDLIB_HIDE };
+enum { MODE_RECURSIVE, MODE_SWEEP };
 
-int decompile(struct vm_program *program, struct rebuilt_program *rp);
+int decompile(struct vm_program *program, struct rebuilt_program *rp,
+	int mode, int jobs);
+int decompile_function(struct vm_program *program, struct rebuilt_program *rp,
+	vmptr_t addr);
 
 #endif
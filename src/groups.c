@@ -29,6 +29,9 @@
  *   [0-30] [100-999]
  * When a group of intervals is set up, you can test if a value is within one
  * of these intervals by calling group_in_group().
+ * Intervals are kept in a balanced binary search tree (AVL) ordered by their
+ * start address, so that both adding an interval and looking up a value run
+ * in O(log(n)), n being the number of disjoint intervals.
  */
 
 #include <stdlib.h>
@@ -38,125 +41,333 @@
 #include "common.h"
 #include "groups.h"
 
-struct group *group_init()
+/**
+ * AVL tree helpers.
+ *
+ * cf. http://en.wikipedia.org/wiki/AVL_tree
+ */
+static int node_height(struct interval_node *node)
+{
+	return node == NULL ? 0 : node->height;
+}
+
+static void node_update_height(struct interval_node *node)
+{
+	int l = node_height(node->left);
+	int r = node_height(node->right);
+
+	node->height = (l > r ? l : r) + 1;
+}
+
+static struct interval_node *node_rotate_right(struct interval_node *node)
+{
+	struct interval_node *left = node->left;
+
+	node->left = left->right;
+	left->right = node;
+	node_update_height(node);
+	node_update_height(left);
+
+	return left;
+}
+
+static struct interval_node *node_rotate_left(struct interval_node *node)
+{
+	struct interval_node *right = node->right;
+
+	node->right = right->left;
+	right->left = node;
+	node_update_height(node);
+	node_update_height(right);
+
+	return right;
+}
+
+static struct interval_node *node_balance(struct interval_node *node)
+{
+	int balance;
+
+	node_update_height(node);
+	balance = node_height(node->left) - node_height(node->right);
+
+	if (balance > 1) {
+		if (node_height(node->left->left) < node_height(node->left->right))
+			node->left = node_rotate_left(node->left);
+		return node_rotate_right(node);
+	} else if (balance < -1) {
+		if (node_height(node->right->right) < node_height(node->right->left))
+			node->right = node_rotate_right(node->right);
+		return node_rotate_left(node);
+	}
+
+	return node;
+}
+
+static struct interval_node *node_insert(struct interval_node *node,
+	struct interval_node *new_node)
+{
+	if (node == NULL)
+		return new_node;
+
+	if (new_node->interval.start < node->interval.start)
+		node->left = node_insert(node->left, new_node);
+	else
+		node->right = node_insert(node->right, new_node);
+
+	return node_balance(node);
+}
+
+/**
+ * Detaches the leftmost node of a subtree, and returns it in *min.
+ */
+static struct interval_node *node_remove_min(struct interval_node *node,
+	struct interval_node **min)
+{
+	if (node->left == NULL) {
+		*min = node;
+		return node->right;
+	}
+
+	node->left = node_remove_min(node->left, min);
+
+	return node_balance(node);
+}
+
+/**
+ * Detaches the node whose interval starts at a given address, and returns it
+ * in *removed.
+ */
+static struct interval_node *node_remove(struct interval_node *node,
+	vmptr_t start, struct interval_node **removed)
+{
+	struct interval_node *left, *right, *min;
+
+	if (node == NULL)
+		return NULL;
+
+	if (start < node->interval.start) {
+		node->left = node_remove(node->left, start, removed);
+	} else if (start > node->interval.start) {
+		node->right = node_remove(node->right, start, removed);
+	} else {
+		left = node->left;
+		right = node->right;
+		*removed = node;
+		if (right == NULL)
+			return left;
+		right = node_remove_min(right, &min);
+		min->left = left;
+		min->right = right;
+		node = min;
+	}
+
+	return node_balance(node);
+}
+
+static void node_free(struct interval_node *node)
+{
+	if (node == NULL)
+		return;
+
+	node_free(node->left);
+	node_free(node->right);
+	free(node);
+}
+
+/**
+ * Returns the first interval (by increasing order) that ends at or after a
+ * given address, or NULL if there is none.
+ * Since intervals are disjoint, ends are sorted the same way as starts.
+ */
+static struct interval_node *node_first_ending_after(
+	struct interval_node *node, vmptr_t addr)
+{
+	struct interval_node *found = NULL;
+
+	while (node != NULL) {
+		if (node->interval.end >= addr) {
+			found = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Returns the first interval (by increasing order) that starts strictly after
+ * a given address, or NULL if there is none.
+ */
+static struct interval_node *node_first_starting_after(
+	struct interval_node *node, vmptr_t addr)
+{
+	struct interval_node *found = NULL;
+
+	while (node != NULL) {
+		if (node->interval.start > addr) {
+			found = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	return found;
+}
+
+static void node_dump(struct interval_node *node)
+{
+	if (node == NULL)
+		return;
+
+	node_dump(node->left);
+	printf("[0x%x-0x%x] ", (int) node->interval.start,
+		(int) node->interval.end);
+	node_dump(node->right);
+}
+
+static void node_get_intervals(struct interval_node *node,
+	struct interval **intervals)
+{
+	if (node == NULL)
+		return;
+
+	node_get_intervals(node->left, intervals);
+	LIST_APPEND(*intervals, node->interval);
+	node_get_intervals(node->right, intervals);
+}
+
+/**
+ * Creates a new empty group. If an arena is given, the group and its intervals
+ * are allocated in it, and released with it.
+ */
+struct group *group_init(struct arena *arena)
 {
 	struct group *group;
 
-	group = malloc(sizeof(struct group));
+	if (arena != NULL)
+		group = arena_alloc(arena, sizeof(struct group));
+	else
+		group = malloc(sizeof(struct group));
 	if (group == NULL)
 		FATAL_ERROR("malloc");
 	memset(group, 0, sizeof(struct group));
-
-	LIST_INIT(group->intervals);
+	group->arena = arena;
 
 	return group;
 }
 
 void group_free(struct group *group)
 {
-	LIST_FREE(group->intervals);
+	struct interval_node *node;
+
+	if (group->arena != NULL)
+		return;
+
+	node_free(group->root);
+	while ((node = group->free_nodes) != NULL) {
+		group->free_nodes = node->right;
+		free(node);
+	}
 
 	free(group);
 }
 
-void group_add_interval(struct group* group, vmptr_t start, vmptr_t end)
+/**
+ * Nodes removed from the tree are kept aside to be used again.
+ */
+static struct interval_node *group_new_node(struct group *group)
 {
-	int i, j;
-	struct interval new_interval;
+	struct interval_node *node;
+
+	if (group->free_nodes != NULL) {
+		node = group->free_nodes;
+		group->free_nodes = node->right;
+		return node;
+	}
 
-	int nobody = 1;
-	int first_one = 0;
-	int last_one = 1;
+	if (group->arena != NULL)
+		node = arena_alloc(group->arena, sizeof(struct interval_node));
+	else
+		node = malloc(sizeof(struct interval_node));
+	if (node == NULL)
+		FATAL_ERROR("malloc");
+
+	return node;
+}
+
+void group_add_interval(struct group* group, vmptr_t start, vmptr_t end)
+{
+	struct interval_node *node, *next, *removed;
 
 	if (start >= end)
 		FATAL_ERROR("start >= end");
 
 	//printf("group_add_interval(0x%x, 0x%x)\n", (int) start, (int) end);
 
-	// Loop until we are at left from the correct interval
-	LIST_ITERATOR(group->intervals, i) {
-		nobody = 0;
-		if (start <= group->intervals[i].end) {
-			last_one = 0;
-			break;
-		}
-	}
-
-	if (nobody) { // First interval, there is no else
-		new_interval.start = start;
-		new_interval.end = end;
-		LIST_APPEND(group->intervals, new_interval);
-		return;
-	}
-
-	if (end < group->intervals[0].start)
-		first_one = 1;
-
-	//LIST_ITERATOR(group->intervals, j) {
-	//	if (end < group->intervals[j].start) {
-	//		j--;
-	//		break;
-	//	}
-	LIST_ITERATOR_REVERSE(group->intervals, j) {
-		if (end >= group->intervals[j].start)
-			break;
-	}
-	//printf("i = %d  j = %d  first_one = %d  last_one = %d\n", i, j, first_one, last_one);
-	/*  ... [i-1]   [_i_]   [i+1] ... [j-1]   [_j_]   [j+1] ...
-	             ¦      ¦                     ¦______¦
-                  ^^^^^^ 
-                   [_____________new____________]               */
+	// Find the first interval that may be merged with the new one
+	node = node_first_ending_after(group->root, start);
 
 	// If we have zero intersection, create a new one
-	if (first_one || last_one || i == j + 1) {
-		new_interval.start = start;
-		new_interval.end = end;
-		LIST_ADD(group->intervals, new_interval, i);
+	if (node == NULL || node->interval.start > end) {
+		node = group_new_node(group);
+		node->interval.start = start;
+		node->interval.end = end;
+		node->left = node->right = NULL;
+		node->height = 1;
+		group->root = node_insert(group->root, node);
+		group->count++;
 		return;
 	}
 
-	// We can merge i and j, if they are different
-	// and, by the way, delete ones between i and j
-	if (i < j) {
-		group->intervals[i].end = group->intervals[j].end;
-		while (i < j) {
-			LIST_REMOVE(group->intervals, i + 1);
-			j--;
-		}
+	// Merge all following intervals that the new one reaches, and delete them
+	while ((next = node_first_starting_after(group->root,
+			node->interval.start)) != NULL && next->interval.start <= end) {
+		if (next->interval.end > end)
+			end = next->interval.end;
+		group->root = node_remove(group->root, next->interval.start,
+			&removed);
+		removed->right = group->free_nodes;
+		group->free_nodes = removed;
+		group->count--;
 	}
-	/*  ... [i-1]    [___i___]    [_i+1_] ...
-	             ¦   ________¦___¦
-                  ^^^^^^^^
-                   [____new____]               */
 
-	// In this last case, all we have to do is to enlarge i
-	if (start < group->intervals[i].start)
-		group->intervals[i].start = start;
-	if (end > group->intervals[i].end)
-		group->intervals[i].end = end;
+	// In this last case, all we have to do is to enlarge the first one:
+	// it stays at the same place in the tree, since it still does not overlap
+	// with its neighbours
+	if (start < node->interval.start)
+		node->interval.start = start;
+	if (end > node->interval.end)
+		node->interval.end = end;
 }
 
 int group_is_in_group(struct group* group, vmptr_t item)
 {
-	int i;
+	struct interval_node *node = group->root;
 
-	LIST_ITERATOR(group->intervals, i) {
-		if (item >= group->intervals[i].start && item < group->intervals[i].end)
+	while (node != NULL) {
+		if (item < node->interval.start)
+			node = node->left;
+		else if (item < node->interval.end)
 			return 1;
-		else if (item < group->intervals[i].start)
-			return 0;
+		else
+			node = node->right;
 	}
 	return 0;
 }
 
 void group_dump(struct group* group)
 {
-	int i;
-	struct interval *interval;
-
-	LIST_ITERATOR(group->intervals, i) {
-		interval = &(group->intervals[i]);
-		printf("[0x%x-0x%x] ", (int) interval->start, (int) interval->end);
-	}
+	node_dump(group->root);
 	printf("\n");
 }
+
+/**
+ * Appends all intervals of a group to a list, by increasing order.
+ */
+void group_get_intervals(struct group *group, struct interval **intervals)
+{
+	node_get_intervals(group->root, intervals);
+}
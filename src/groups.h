@@ -29,6 +29,9 @@
  *   [0-30] [100-999]
  * When a group of intervals is set up, you can test if a value is within one
  * of these intervals by calling group_in_group().
+ * Intervals are kept in a balanced binary search tree (AVL) ordered by their
+ * start address, so that both adding an interval and looking up a value run
+ * in O(log(n)), n being the number of disjoint intervals.
  */
 
 #if !defined(GROUPS_H)
@@ -36,6 +39,7 @@
 
 #include <unistd.h>
 
+#include "arena.h"
 #include "common.h"
 
 struct interval {
@@ -43,16 +47,27 @@ struct interval {
 	vmptr_t end;
 };
 
+struct interval_node {
+	struct interval interval;
+	struct interval_node *left;
+	struct interval_node *right;
+	int height;
+};
+
 struct group {
-	struct interval *intervals;
+	struct interval_node *root;
+	int count;
+	struct interval_node *free_nodes;
+	struct arena *arena;
 };
 
-struct group *group_init();
+struct group *group_init(struct arena *arena);
 void group_free(struct group *group);
 void group_dump(struct group *group);
 
 void group_add_interval(struct group *group, vmptr_t start, vmptr_t end);
 
 int group_is_in_group(struct group *group, vmptr_t item);
+void group_get_intervals(struct group *group, struct interval **intervals);
 
 #endif
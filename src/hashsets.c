@@ -0,0 +1,219 @@
+/**
+ * @file    hashsets.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a set of 32-bit integers (addresses, functions ids, system
+ * calls numbers...), stored in an open-addressing hash table. Adding a value
+ * and testing if a value is in the set are done in O(1) expected time, which
+ * makes it suitable to remove duplicates from a long list of values.
+ * The same table also gives a map from 32-bit integers to integers (functions
+ * ids...): a map is a set that keeps a value for each key.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "hashsets.h"
+
+#define HASHSET_INITIAL_SIZE	64
+
+/**
+ * Hash function for 32-bit keys (Fibonacci hashing). The high bits of the
+ * product are the well mixed ones, so they are folded onto the low bits that
+ * index the table.
+ */
+static uint32_t hashset_slot(struct hashset *set, uint32_t key)
+{
+	uint32_t hash = key * 2654435769u;
+
+	return (hash ^ (hash >> 16)) & (set->size - 1);
+}
+
+static void hashset_alloc(struct hashset *set, uint32_t size, int with_values)
+{
+	set->size = size;
+	set->count = 0;
+	set->keys = malloc(size * sizeof(uint32_t));
+	set->values = with_values ? malloc(size * sizeof(int)) : NULL;
+	set->used = calloc(size, sizeof(uint8_t));
+	if (set->keys == NULL || (with_values && set->values == NULL)
+		|| set->used == NULL)
+		FATAL_ERROR("malloc");
+}
+
+static struct hashset *hashset_new(int with_values)
+{
+	struct hashset *set;
+
+	set = malloc(sizeof(struct hashset));
+	if (set == NULL)
+		FATAL_ERROR("malloc");
+
+	hashset_alloc(set, HASHSET_INITIAL_SIZE, with_values);
+
+	return set;
+}
+
+struct hashset *hashset_init()
+{
+	return hashset_new(0);
+}
+
+/**
+ * Creates a map: a set that also keeps a value for each key (cf.
+ * hashmap_get() and hashmap_set()).
+ */
+struct hashset *hashmap_init()
+{
+	return hashset_new(1);
+}
+
+void hashset_free(struct hashset *set)
+{
+	free(set->keys);
+	free(set->values);
+	free(set->used);
+
+	free(set);
+}
+
+/**
+ * Removes all values from the set, keeping its memory for later use.
+ */
+void hashset_clear(struct hashset *set)
+{
+	if (set->count == 0)
+		return;
+
+	memset(set->used, 0, set->size * sizeof(uint8_t));
+	set->count = 0;
+}
+
+/**
+ * Finds the slot of a key: the one holding it if it is in the set, else the
+ * free one where it would be added.
+ */
+static uint32_t hashset_find(struct hashset *set, uint32_t key)
+{
+	uint32_t slot;
+
+	for (slot = hashset_slot(set, key); set->used[slot];
+		slot = (slot + 1) & (set->size - 1))
+		if (set->keys[slot] == key)
+			break;
+
+	return slot;
+}
+
+int hashset_contains(struct hashset *set, uint32_t key)
+{
+	return set->used[hashset_find(set, key)];
+}
+
+/**
+ * Doubles the size of the hash table, and re-inserts all values.
+ */
+static void hashset_grow(struct hashset *set)
+{
+	uint32_t *old_keys = set->keys;
+	int *old_values = set->values;
+	uint8_t *old_used = set->used;
+	uint32_t old_size = set->size;
+	uint32_t i, slot;
+
+	hashset_alloc(set, 2 * old_size, old_values != NULL);
+
+	for (i = 0; i < old_size; i++) {
+		if (!old_used[i])
+			continue;
+		slot = hashset_find(set, old_keys[i]);
+		set->keys[slot] = old_keys[i];
+		if (old_values != NULL)
+			set->values[slot] = old_values[i];
+		set->used[slot] = 1;
+		set->count++;
+	}
+
+	free(old_keys);
+	free(old_values);
+	free(old_used);
+}
+
+/**
+ * Adds a key in a free slot (cf. hashset_find()), growing the table to keep
+ * it at most half full.
+ */
+static void hashset_insert(struct hashset *set, uint32_t slot, uint32_t key,
+	int value)
+{
+	set->keys[slot] = key;
+	if (set->values != NULL)
+		set->values[slot] = value;
+	set->used[slot] = 1;
+	set->count++;
+
+	if (2 * set->count > set->size)
+		hashset_grow(set);
+}
+
+/**
+ * Adds a value to the set. Returns 1 if it was added, 0 if it was already in
+ * the set.
+ */
+int hashset_add(struct hashset *set, uint32_t key)
+{
+	uint32_t slot = hashset_find(set, key);
+
+	if (set->used[slot])
+		return 0;
+	hashset_insert(set, slot, key, 0);
+
+	return 1;
+}
+
+/**
+ * Gets the value of a key in a map. Returns 1 if the key is in the map, 0
+ * otherwise.
+ */
+int hashmap_get(struct hashset *map, uint32_t key, int *value)
+{
+	uint32_t slot = hashset_find(map, key);
+
+	if (!map->used[slot])
+		return 0;
+	*value = map->values[slot];
+
+	return 1;
+}
+
+/**
+ * Sets the value of a key in a map, replacing the previous one if any.
+ */
+void hashmap_set(struct hashset *map, uint32_t key, int value)
+{
+	uint32_t slot = hashset_find(map, key);
+
+	if (map->used[slot])
+		map->values[slot] = value;
+	else
+		hashset_insert(map, slot, key, value);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file    hashsets.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a set of 32-bit integers (addresses, functions ids, system
+ * calls numbers...), stored in an open-addressing hash table. Adding a value
+ * and testing if a value is in the set are done in O(1) expected time, which
+ * makes it suitable to remove duplicates from a long list of values.
+ * The same table also gives a map from 32-bit integers to integers (functions
+ * ids...): a map is a set that keeps a value for each key.
+ */
+
+#if !defined(HASHSETS_H)
+#define HASHSETS_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+struct hashset {
+	uint32_t *keys;
+	int *values; // NULL in a set, cf. hashmap_init()
+	uint8_t *used;
+	uint32_t size; // always a power of two
+	uint32_t count;
+};
+
+struct hashset *hashset_init();
+struct hashset *hashmap_init();
+void hashset_free(struct hashset *set);
+void hashset_clear(struct hashset *set);
+
+int hashset_contains(struct hashset *set, uint32_t key);
+int hashset_add(struct hashset *set, uint32_t key);
+
+int hashmap_get(struct hashset *map, uint32_t key, int *value);
+void hashmap_set(struct hashset *map, uint32_t key, int value);
+
+#endif
@@ -25,34 +25,126 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
+#include "database.h"
 #include "decompiler.h"
 #include "common.h"
+#include "query.h"
 #include "rebuilt_program.h"
+#include "server.h"
 #include "vm.h"
 
 #define USAGE	\
 	"Usage: %s action [options] program\n"\
+	"       %s serve [options] socket\n"\
 	"actions:\n"\
 	"  help      display this help\n"\
 	"  fn        dump functions\n"\
 	"  cg        generate callgraph\n"\
 	"  cfg       generate CFG (option -f needed)\n"\
+	"  addr      show the function containing an address (option -f needed)\n"\
+	"  cmp       compare the functions found by both modes\n"\
+	"  index     save the analysis in a database, used by fn, cg and cfg\n"\
+	"  batch     run queries read from stdin (or -q), e.g. \"cfg main > f.dot\"\n"\
+	"  serve     answer queries of clients (option -S) on a Unix socket\n"\
 	"options:\n"\
 	"  -s        show standard C library\n"\
 	"  -f FN     limit action to function FN (name or address)\n"\
+	"  -j N      use N threads to sweep and to read functions (branches are\n"\
+	"            still followed from the entry point by one thread)\n"\
+	"  -m MODE   find functions by following branches from the entry point\n"\
+	"            (recursive, default) or by reading all code (sweep)\n"\
+	"  -l        only decompile the function given with -f (fn, cfg): faster,\n"\
+	"            but functions without symbols are numbered differently\n"\
+	"  -d FILE   database of the program (default: program.aadb)\n"\
+	"  -q FILE   read the queries of action batch from FILE\n"\
+	"  -S SOCKET ask the server on SOCKET (actions fn, cg, cfg, addr, batch)\n"\
+	"  -M MB     memory for the programs kept by action serve (default: 256)\n"\
 	"options for action fn:\n"\
 	"  -c        compact dump (names, addresses and childs)\n"\
 	"  -cc       very compact dump (only addresses)\n"
 #define usage()	\
-	printf(USAGE, argv[0]);
+	printf(USAGE, argv[0], argv[0]);
 
-enum {
-	ACTION_HELP,
-	ACTION_DUMP_FUNCTIONS,
-	ACTION_MAKE_CALLGRAPH,
-	ACTION_MAKE_CFG
-};
+/**
+ * Sends a query to a server, and writes its result. Returns 0 on success, or
+ * -1 with a message in error (QUERY_ERROR_SIZE bytes).
+ */
+static int ask_server(int server, const char *binary, struct query *query,
+	FILE *out, char *error)
+{
+	char text[SERVER_MAX_REQUEST], *response;
+	int status;
+
+	query_format(query, text, sizeof(text));
+	status = server_ask(server, binary, text, &response);
+	if (status < 0) {
+		snprintf(error, QUERY_ERROR_SIZE, "no answer from the server");
+		return -1;
+	}
+	if (status == 0)
+		fputs(response, out);
+	else
+		snprintf(error, QUERY_ERROR_SIZE, "%s", response);
+	free(response);
+
+	return status == 0 ? 0 : -1;
+}
+
+/**
+ * Runs queries read from a file, one per line (cf. query_parse()), on a program
+ * decompiled once, or sends them to a server if server is not -1. Options of
+ * the command line are defaults for all queries. Returns the number of queries
+ * that failed.
+ */
+static int run_batch(struct vm_program *program, struct rebuilt_program *rp,
+	int server, const char *binary, FILE *queries, int hide_stdlib,
+	int compacity)
+{
+	struct query query;
+	char *line = NULL, error[QUERY_ERROR_SIZE];
+	size_t line_size = 0;
+	int number = 0, failed = 0, status;
+	FILE *out = stdout;
+
+	while (getline(&line, &line_size, queries) != -1) {
+		number++;
+		query.hide_stdlib = hide_stdlib;
+		query.compacity = compacity;
+		status = query_parse(&query, line, error);
+		if (status == 1)
+			continue;
+
+		if (status == 0) {
+			out = query.output != NULL ? fopen(query.output, "w") : stdout;
+			if (out == NULL) {
+				snprintf(error, QUERY_ERROR_SIZE, "can not write %s",
+					query.output);
+				status = -1;
+			}
+		}
+		if (status == 0) {
+			if (server < 0)
+				status = query_run(program, rp, out, &query, error);
+			else
+				status = ask_server(server, binary, &query, out, error);
+			if (out != stdout && fclose(out) != 0 && status == 0) {
+				snprintf(error, QUERY_ERROR_SIZE, "can not write %s",
+					query.output);
+				status = -1;
+			}
+		}
+
+		if (status != 0) {
+			fprintf(stderr, "error: query %d: %s\n", number, error);
+			failed++;
+		}
+	}
+	free(line);
+
+	return failed;
+}
 
 /**
  * This is the entry point of the program.
@@ -67,13 +159,28 @@ int main(int argc, char **argv)
 	char *function = NULL;
 	vmptr_t function_addr = 0;
 	int compacity = 0;
+	int mode = MODE_RECURSIVE;
+	int jobs = 1;
+	int lazy = 0;
+	int memory = SERVER_DEFAULT_MEMORY;
 	char *binary;
+	char binary_path[PATH_MAX];
+	char *database_file = NULL;
+	char *queries_file = NULL;
+	char *server_socket = NULL;
+	FILE *queries = stdin;
+	int server;
 
-	struct vm_program *program;
-	struct rebuilt_program *rp;
+	struct query query;
+	char error[QUERY_ERROR_SIZE];
+
+	struct database *database = NULL;
+	struct vm_program *program = NULL;
+	struct rebuilt_program *rp = NULL, *rp_sweep;
+	int count, count_sweep;
 
 	// Get the options
-	while ((c = getopt(argc, argv, "sf:c")) != -1) {
+	while ((c = getopt(argc, argv, "sf:cj:lm:d:q:S:M:")) != -1) {
 		switch (c) {
 		case 's':
 			hide_stdlib = STDLIB_SHOW;
@@ -84,8 +191,46 @@ int main(int argc, char **argv)
 		case 'c':
 			compacity++;
 			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1) {
+				fprintf(stderr, "Option -j requires a positive number.\n");
+				return 1;
+			}
+			break;
+		case 'l':
+			lazy = 1;
+			break;
+		case 'm':
+			if (strcmp(optarg, "recursive") == 0) {
+				mode = MODE_RECURSIVE;
+			} else if (strcmp(optarg, "sweep") == 0) {
+				mode = MODE_SWEEP;
+			} else {
+				fprintf(stderr, "Unknown mode `%s'.\n", optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			database_file = optarg;
+			break;
+		case 'q':
+			queries_file = optarg;
+			break;
+		case 'S':
+			server_socket = optarg;
+			break;
+		case 'M':
+			memory = atoi(optarg);
+			if (memory < 1) {
+				fprintf(stderr, "Option -M requires a positive number.\n");
+				return 1;
+			}
+			break;
 		case '?':
-			if (optopt == 'f')
+			if (optopt == 'f' || optopt == 'j' || optopt == 'm'
+				|| optopt == 'd' || optopt == 'q' || optopt == 'S'
+				|| optopt == 'M')
 				fprintf(stderr, "Option -%c requires an argument.\n", optopt);
 			else if (isprint(optopt))
 				fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -105,12 +250,20 @@ int main(int argc, char **argv)
 		//action = ACTION_HELP;
 		usage();
 		return 0;
-	} else if (strcmp(argv[optind], "fn") == 0) {
-		action = ACTION_DUMP_FUNCTIONS;
-	} else if (strcmp(argv[optind], "cg") == 0) {
-		action = ACTION_MAKE_CALLGRAPH;
-	} else if (strcmp(argv[optind], "cfg") == 0 && function != NULL) {
-		action = ACTION_MAKE_CFG;
+	} else if ((action = query_get_action(argv[optind])) != ACTION_HELP) {
+		if ((action == ACTION_MAKE_CFG || action == ACTION_FIND_FUNCTION)
+			&& function == NULL) {
+			usage();
+			return 1;
+		}
+	} else if (strcmp(argv[optind], "cmp") == 0) {
+		action = ACTION_COMPARE_MODES;
+	} else if (strcmp(argv[optind], "index") == 0) {
+		action = ACTION_INDEX;
+	} else if (strcmp(argv[optind], "batch") == 0) {
+		action = ACTION_BATCH;
+	} else if (strcmp(argv[optind], "serve") == 0) {
+		action = ACTION_SERVE;
 	} else {
 		usage();
 		return 1;
@@ -122,51 +275,116 @@ int main(int argc, char **argv)
 		usage();
 		return 1;
 	}
-	// Get the binary program name
+	// Get the binary program name (or the socket to listen on)
 	binary = argv[optind];
+	if (action == ACTION_SERVE)
+		return server_run(binary, mode, jobs, (size_t) memory << 20);
 
-	// Start the virtual machine
-	program = vm_open_program(binary);
-
-	if (function != NULL) {
-		// If a function was given, decode it...
-		//     Is it an address?
-		if (function[0] == '0' && function[1] == 'x') {
-			errno = 0;
-			function_addr = strtol(function, NULL, 16);
-			if (errno != 0) // error decoding the string
-				function_addr = 0;
+	query.action = action;
+	query.hide_stdlib = hide_stdlib;
+	query.compacity = compacity;
+	query.function = function;
+	query.output = NULL;
+
+	if (action == ACTION_BATCH && queries_file != NULL) {
+		queries = fopen(queries_file, "r");
+		if (queries == NULL) {
+			fprintf(stderr, "Can not read queries from %s.\n", queries_file);
+			return 1;
 		}
-		//     It's not an address, so let's find it in the symbols
-		if (function_addr == 0) {
-			if (vm_get_symbol_addr(program, function, &function_addr) != 0) {
-				printf("error: function not found: \"%s\"\n", function);
-				ret = 1;
-				goto end_vm;
-			}
+	}
+
+	// Ask a server to do the job, if one was given
+	if (server_socket != NULL && action != ACTION_COMPARE_MODES
+		&& action != ACTION_INDEX) {
+		if (realpath(binary, binary_path) == NULL) {
+			fprintf(stderr, "Can not find %s.\n", binary);
+			ret = 1;
+			goto end;
+		}
+		server = server_connect(server_socket);
+		if (server < 0) {
+			fprintf(stderr, "Can not connect to %s.\n", server_socket);
+			ret = 1;
+			goto end;
+		}
+		if (action == ACTION_BATCH) {
+			ret = run_batch(NULL, NULL, server, binary_path, queries,
+				hide_stdlib, compacity) != 0;
+		} else if (ask_server(server, binary_path, &query, stdout,
+			error) != 0) {
+			printf("error: %s\n", error);
+			ret = 1;
 		}
+		close(server);
+		goto end;
 	}
 
-	// Create a new rebuilt program and launch decompilation!
+	if (database_file == NULL) {
+		database_file = malloc(strlen(binary) + sizeof(DATABASE_SUFFIX));
+		if (database_file == NULL)
+			FATAL_ERROR("malloc");
+		sprintf(database_file, "%s%s", binary, DATABASE_SUFFIX);
+	}
+
+	// Use the database of the program if it is up to date, else start the
+	// virtual machine
 	rp = rp_new();
-	decompile(program, rp);
+	if (action != ACTION_INDEX && action != ACTION_COMPARE_MODES)
+		database = database_open(database_file, binary, mode, rp);
+	if (database == NULL)
+		program = vm_open_program(binary);
 
-	// Finally, display what the user wants
-	if (action == ACTION_DUMP_FUNCTIONS) {
-		if (function != NULL)
-			rp_dump_function_by_addr(rp, function_addr, compacity);
+	// If a function was given, decode it
+	if (action != ACTION_BATCH && function != NULL
+		&& query_find_function(program, rp, function, &function_addr) != 0) {
+		printf("error: function not found: \"%s\"\n", function);
+		ret = 1;
+		goto end_vm;
+	}
+
+	// Launch decompilation!
+	if (database == NULL) {
+		if (action == ACTION_COMPARE_MODES)
+			mode = MODE_RECURSIVE;
+		if (lazy && function != NULL && (action == ACTION_DUMP_FUNCTIONS
+			|| action == ACTION_MAKE_CFG))
+			decompile_function(program, rp, function_addr);
 		else
-			rp_dump_functions(rp, hide_stdlib, compacity);
-	} else if (action == ACTION_MAKE_CALLGRAPH) {
-		rp_dump_callgraph(rp, hide_stdlib);
-	} else if (action == ACTION_MAKE_CFG) {
-		rp_dump_cfg_for_function(rp, function_addr);
+			decompile(program, rp, mode, jobs);
 	}
 
-	rp_free(rp);
+	// Finally, display what the user wants
+	if (action == ACTION_BATCH) {
+		ret = run_batch(program, rp, -1, binary, queries, hide_stdlib,
+			compacity) != 0;
+	} else if (action == ACTION_COMPARE_MODES) {
+		rp_sweep = rp_new();
+		decompile(program, rp_sweep, MODE_SWEEP, jobs);
+		printf(" == functions found by recursive traversal only ==\n");
+		count = rp_dump_functions_missing(rp, stdout, rp_sweep, hide_stdlib);
+		printf(" == functions found by linear sweep only ==\n");
+		count_sweep = rp_dump_functions_missing(rp_sweep, stdout, rp,
+			hide_stdlib);
+		printf(" == %d functions found by recursive traversal only, "
+			"%d by linear sweep only ==\n", count, count_sweep);
+		rp_free(rp_sweep);
+	} else if (action == ACTION_INDEX) {
+		database_write(database_file, program, rp, mode);
+	} else if (query_run(program, rp, stdout, &query, error) != 0) {
+		printf("error: %s\n", error);
+		ret = 1;
+	}
 
 end_vm:
-	vm_close_program(program);
+	if (database != NULL)
+		database_close(database);
+	else
+		vm_close_program(program);
+	rp_free(rp);
+end:
+	if (queries != stdin)
+		fclose(queries);
 
 	return ret;
 }
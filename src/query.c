@@ -0,0 +1,217 @@
+/**
+ * @file    query.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file parses and runs queries on a rebuilt program: dumps of functions,
+ * callgraph, CFG of a function, or the function containing an address. A
+ * query is written like the command line, e.g. "fn -c", "cfg -f main" or
+ * "cfg main", so that many of them can be read from a file (action batch) or
+ * sent to a server (action serve).
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "decompiler.h"
+#include "query.h"
+
+#define QUERY_SEPARATORS	" \t\r\n"
+
+/**
+ * Names of the actions that are queries.
+ */
+static const char *query_actions[] = {
+	[ACTION_DUMP_FUNCTIONS] = "fn",
+	[ACTION_MAKE_CALLGRAPH] = "cg",
+	[ACTION_MAKE_CFG] = "cfg",
+	[ACTION_FIND_FUNCTION] = "addr",
+};
+
+/**
+ * Returns the query action with the given name, or ACTION_HELP.
+ */
+int query_get_action(const char *name)
+{
+	int action;
+
+	for (action = ACTION_DUMP_FUNCTIONS; action <= ACTION_FIND_FUNCTION;
+		action++)
+		if (strcmp(name, query_actions[action]) == 0)
+			return action;
+
+	return ACTION_HELP;
+}
+
+/**
+ * Parses a query: an action with its options and function, like on the command
+ * line but with the function also allowed alone (e.g. "cfg main"), and
+ * optionally followed by "> FILE". The line is modified, and the query points
+ * into it. Options that are not given keep the values of the query (defaults).
+ * Returns 0 on success, 1 for an empty line or a comment (starting with '#'),
+ * and -1 on error, with a message in error (QUERY_ERROR_SIZE bytes).
+ */
+int query_parse(struct query *query, char *line, char *error)
+{
+	char *word;
+	int i;
+
+	query->function = NULL;
+	query->output = NULL;
+
+	word = strtok(line, QUERY_SEPARATORS);
+	if (word == NULL || word[0] == '#')
+		return 1;
+	query->action = query_get_action(word);
+	if (query->action == ACTION_HELP) {
+		snprintf(error, QUERY_ERROR_SIZE, "unknown action `%s'", word);
+		return -1;
+	}
+
+	while ((word = strtok(NULL, QUERY_SEPARATORS)) != NULL) {
+		if (word[0] == '>') {
+			query->output = word[1] != '\0' ? word + 1
+				: strtok(NULL, QUERY_SEPARATORS);
+			if (query->output == NULL) {
+				snprintf(error, QUERY_ERROR_SIZE, "> requires a file name");
+				return -1;
+			}
+		} else if (word[0] == '-') {
+			for (i = 1; word[i] != '\0'; i++) {
+				if (word[i] == 's') {
+					query->hide_stdlib = STDLIB_SHOW;
+				} else if (word[i] == 'c') {
+					query->compacity++;
+				} else if (word[i] == 'f' && word[i + 1] == '\0'
+					&& query->function == NULL
+					&& (query->function = strtok(NULL, QUERY_SEPARATORS))
+					!= NULL) {
+					break;
+				} else {
+					snprintf(error, QUERY_ERROR_SIZE, "bad option `%s'", word);
+					return -1;
+				}
+			}
+		} else if (query->function == NULL) {
+			query->function = word;
+		} else {
+			snprintf(error, QUERY_ERROR_SIZE, "unexpected `%s'", word);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes a query back as text, without its output file, to send it to a
+ * server (cf. server.c).
+ */
+void query_format(struct query *query, char *buffer, size_t size)
+{
+	char compacity[8] = "";
+	int i;
+
+	for (i = 0; i < query->compacity && i < 6; i++)
+		compacity[i] = 'c';
+	snprintf(buffer, size, "%s%s%s%s%s%s", query_actions[query->action],
+		query->hide_stdlib == STDLIB_SHOW ? " -s" : "",
+		compacity[0] != '\0' ? " -" : "", compacity,
+		query->function != NULL ? " -f " : "",
+		query->function != NULL ? query->function : "");
+}
+
+/**
+ * Finds the start address of a function, given by its name or its address.
+ * Names are looked up in the symbols of the program, or in the functions of
+ * the rebuilt program if the program is not loaded. Returns 0 on success.
+ */
+int query_find_function(struct vm_program *program,
+	struct rebuilt_program *rp, const char *function, vmptr_t *function_addr)
+{
+	int f_id;
+
+	*function_addr = 0;
+	//     Is it an address?
+	if (function[0] == '0' && function[1] == 'x') {
+		errno = 0;
+		*function_addr = strtol(function, NULL, 16);
+		if (errno != 0) // error decoding the string
+			*function_addr = 0;
+	}
+	if (*function_addr != 0)
+		return 0;
+
+	//     It's not an address, so let's find it in the symbols
+	if (program != NULL)
+		return vm_get_symbol_addr(program, function, function_addr);
+	f_id = rp_get_function_by_name(rp, function);
+	if (f_id < 0)
+		return -1;
+	*function_addr = rp->functions[f_id].vaddr_start;
+
+	return 0;
+}
+
+/**
+ * Displays the result of a query. The program is only used to find names of
+ * functions, and can be NULL (cf. query_find_function). Returns 0 on success,
+ * or -1 with a message in error (QUERY_ERROR_SIZE bytes).
+ */
+int query_run(struct vm_program *program, struct rebuilt_program *rp,
+	FILE *out, struct query *query, char *error)
+{
+	vmptr_t function_addr = 0;
+
+	if (query->function == NULL && (query->action == ACTION_MAKE_CFG
+		|| query->action == ACTION_FIND_FUNCTION)) {
+		snprintf(error, QUERY_ERROR_SIZE, "%s requires a function",
+			query_actions[query->action]);
+		return -1;
+	}
+	if (query->function != NULL && query_find_function(program, rp,
+		query->function, &function_addr) != 0) {
+		snprintf(error, QUERY_ERROR_SIZE, "function not found: \"%s\"",
+			query->function);
+		return -1;
+	}
+
+	if (query->action == ACTION_DUMP_FUNCTIONS) {
+		if (query->function != NULL)
+			rp_dump_function_by_addr(rp, out, function_addr,
+				query->compacity);
+		else
+			rp_dump_functions(rp, out, query->hide_stdlib, query->compacity);
+	} else if (query->action == ACTION_MAKE_CALLGRAPH) {
+		rp_dump_callgraph(rp, out, query->hide_stdlib);
+	} else if (query->action == ACTION_MAKE_CFG) {
+		rp_dump_cfg_for_function(rp, out, function_addr);
+	} else if (query->action == ACTION_FIND_FUNCTION) {
+		if (rp_dump_function_containing(rp, out, function_addr) != 0) {
+			snprintf(error, QUERY_ERROR_SIZE,
+				"no function contains address 0x%x", (int) function_addr);
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file    query.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file parses and runs queries on a rebuilt program: dumps of functions,
+ * callgraph, CFG of a function, or the function containing an address. A
+ * query is written like the command line, e.g. "fn -c", "cfg -f main" or
+ * "cfg main", so that many of them can be read from a file (action batch) or
+ * sent to a server (action serve).
+ */
+
+#if !defined(QUERY_H)
+#define QUERY_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "rebuilt_program.h"
+#include "vm.h"
+
+#define QUERY_ERROR_SIZE	256
+
+/**
+ * Actions of the command line. The first ones are queries.
+ */
+enum {
+	ACTION_HELP,
+	ACTION_DUMP_FUNCTIONS,
+	ACTION_MAKE_CALLGRAPH,
+	ACTION_MAKE_CFG,
+	ACTION_FIND_FUNCTION,
+	ACTION_COMPARE_MODES,
+	ACTION_INDEX,
+	ACTION_BATCH,
+	ACTION_SERVE
+};
+
+struct query {
+	int action;
+	int hide_stdlib;
+	int compacity;
+	char *function; // name or address, or NULL
+	char *output; // file to write the result to, or NULL for stdout
+};
+
+int query_get_action(const char *name);
+
+int query_parse(struct query *query, char *line, char *error);
+void query_format(struct query *query, char *buffer, size_t size);
+
+int query_find_function(struct vm_program *program,
+	struct rebuilt_program *rp, const char *function, vmptr_t *function_addr);
+int query_run(struct vm_program *program, struct rebuilt_program *rp,
+	FILE *out, struct query *query, char *error);
+
+#endif
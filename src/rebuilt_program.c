@@ -42,6 +42,165 @@ void statement_dump(struct statement* s)
 		STATEMENT_COND(s->cond), STATEMENT_STATICITY(s->staticity));
 }
 
+/**
+ * Initializes an empty list of statements, allocated in an arena.
+ */
+void statements_init(struct statements *st, struct arena *arena)
+{
+	LIST_INIT_ARENA(st->addr, arena);
+	LIST_INIT_ARENA(st->to_addr, arena);
+	LIST_INIT_ARENA(st->value, arena);
+	LIST_INIT_ARENA(st->to_function, arena);
+	LIST_INIT_ARENA(st->flags, arena);
+}
+
+/**
+ * Makes room for a number of statements in a list of statements.
+ */
+void statements_reserve(struct statements *st, int capacity)
+{
+	LIST_RESERVE(st->addr, capacity);
+	LIST_RESERVE(st->to_addr, capacity);
+	LIST_RESERVE(st->value, capacity);
+	LIST_RESERVE(st->to_function, capacity);
+	LIST_RESERVE(st->flags, capacity);
+}
+
+/**
+ * Appends a statement to a list of statements.
+ */
+void statements_append(struct statements *st, struct statement *s)
+{
+	LIST_APPEND(st->addr, s->addr);
+	LIST_APPEND(st->to_addr, s->to_addr);
+	LIST_APPEND(st->value, s->value);
+	LIST_APPEND(st->to_function, s->to_function);
+	LIST_APPEND(st->flags, STATEMENT_FLAGS(s->type, s->cond, s->br_type,
+		s->staticity));
+}
+
+/**
+ * Reads the i-th statement of a list of statements into s.
+ */
+void statements_get(struct statements *st, int i, struct statement *s)
+{
+	s->addr = st->addr[i];
+	s->to_addr = st->to_addr[i];
+	s->value = st->value[i];
+	s->to_function = st->to_function[i];
+	s->type = STATEMENT_GET_TYPE(st->flags[i]);
+	s->cond = STATEMENT_GET_COND(st->flags[i]);
+	s->br_type = STATEMENT_GET_BR_TYPE(st->flags[i]);
+	s->staticity = STATEMENT_GET_STATICITY(st->flags[i]);
+}
+
+#define SWAP(_a, _b)	\
+	do {\
+		typeof(_a) _tmp = _a;\
+		_a = _b;\
+		_b = _tmp;\
+	} while (0)
+
+void statements_swap(struct statements *st, int i, int j)
+{
+	SWAP(st->addr[i], st->addr[j]);
+	SWAP(st->to_addr[i], st->to_addr[j]);
+	SWAP(st->value[i], st->value[j]);
+	SWAP(st->to_function[i], st->to_function[j]);
+	SWAP(st->flags[i], st->flags[j]);
+}
+
+void statements_remove(struct statements *st, int i)
+{
+	LIST_REMOVE(st->addr, i);
+	LIST_REMOVE(st->to_addr, i);
+	LIST_REMOVE(st->value, i);
+	LIST_REMOVE(st->to_function, i);
+	LIST_REMOVE(st->flags, i);
+}
+
+struct statement_order {
+	vmptr_t addr;
+	int i;
+};
+
+/**
+ * Puts the elements of a list in a given order, using a scratch buffer.
+ */
+#define STATEMENTS_REORDER(_list, _order, _scratch, _length)	\
+	do {\
+		typeof(_list) _tmp = (typeof(_list)) (_scratch);\
+		int _j;\
+		for (_j = 0; _j < (_length); _j++)\
+			_tmp[_j] = (_list)[(_order)[_j].i];\
+		memcpy(_list, _tmp, (_length) * sizeof(*(_list)));\
+	} while (0)
+
+/**
+ * Sorts statements by address. The sort is stable: statements at the same
+ * address keep their order. Addresses are sorted along with their index, then
+ * each list is put in that order.
+ */
+void statements_sort(struct statements *st)
+{
+	struct statement_order *order;
+	uint32_t *scratch;
+	int i, length = STATEMENTS_LENGTH(st);
+
+	if (length < 2)
+		return;
+
+	order = malloc(length * sizeof(*order));
+	scratch = malloc(length * sizeof(*scratch));
+	if (order == NULL || scratch == NULL)
+		FATAL_ERROR("malloc");
+
+	for (i = 0; i < length; i++) {
+		order[i].addr = st->addr[i];
+		order[i].i = i;
+	}
+	radix_sort(order, sizeof(*order), length,
+		offsetof(struct statement_order, addr));
+
+	for (i = 0; i < length; i++)
+		st->addr[i] = order[i].addr;
+	STATEMENTS_REORDER(st->to_addr, order, scratch, length);
+	STATEMENTS_REORDER(st->value, order, scratch, length);
+	STATEMENTS_REORDER(st->to_function, order, scratch, length);
+	STATEMENTS_REORDER(st->flags, order, scratch, length);
+
+	free(scratch);
+	free(order);
+}
+
+/**
+ * Initializes the contents of a rebuilt_program structure. All its lists, and
+ * the explored group, are allocated in its arena.
+ */
+static void rp_init(struct rebuilt_program *rp, struct arena *arena)
+{
+	memset(rp, 0, sizeof(struct rebuilt_program));
+	rp->arena = arena;
+
+	statements_init(&(rp->statements), rp->arena);
+	LIST_INIT_ARENA(rp->functions, rp->arena);
+	LIST_INIT_ARENA(rp->functions_index, rp->arena);
+	rp->functions_by_addr = hashmap_init();
+	rp->explored = group_init(rp->arena);
+}
+
+/**
+ * Frees what is not allocated in the arena of a rebuilt_program structure.
+ */
+static void rp_release(struct rebuilt_program *rp)
+{
+	if (rp->explored_map != NULL)
+		bitmap_free(rp->explored_map);
+	if (rp->words != NULL)
+		hashset_free(rp->words);
+	hashset_free(rp->functions_by_addr);
+}
+
 /**
  * Creates and initializes a new rebuilt_program structure.
  */
@@ -52,43 +211,58 @@ struct rebuilt_program *rp_new()
 	rp = malloc(sizeof(struct rebuilt_program));
 	if (rp == NULL)
 		FATAL_ERROR("malloc");
-	memset(rp, 0, sizeof(struct rebuilt_program));
 
-	LIST_INIT(rp->statements);
-	LIST_INIT(rp->functions);
-	rp->explored = group_init();
+	rp_init(rp, arena_init());
 
 	return rp;
 }
 
 /**
- * Frees a rebuilt_program structure allocated by rp_new().
+ * Frees a rebuilt_program structure allocated by rp_new(). Since all its lists
+ * are in its arena, they are released at once.
  */
 void rp_free(struct rebuilt_program *rp)
 {
-	int i;
+	rp_release(rp);
+	arena_free(rp->arena);
 
-	LIST_ITERATOR(rp->functions, i)
-		LIST_FREE(rp->functions[i].statements);
+	free(rp);
+}
 
-	group_free(rp->explored);
-	LIST_FREE(rp->functions);
-	LIST_FREE(rp->statements);
+/**
+ * Empties a rebuilt_program structure, so that it can be used to decompile
+ * another program. Its memory is kept for that next use, instead of being
+ * given back to the system.
+ */
+void rp_reset(struct rebuilt_program *rp)
+{
+	struct arena *arena = rp->arena;
+
+	rp_release(rp);
+	arena_reset(arena);
+
+	rp_init(rp, arena);
 }
 
 /**
- * Adds a functions to the rebuilt_program's list of functions.
+ * Adds a functions to the rebuilt_program's list of functions, starting at a
+ * given address.
  */
-int rp_add_function(struct rebuilt_program *rp)
+int rp_add_function(struct rebuilt_program *rp, vmptr_t vaddr_start)
 {
 	struct rebuilt_function function;
+	int f_id;
 
 	memset(&function, 0, sizeof(function));
 	function.id = LIST_LENGTH(rp->functions);
+	function.vaddr_start = vaddr_start;
+	function.tail_function = -1;
 	function.from_stdlib = 0;
 	LIST_APPEND(rp->functions, function);
 
-	LIST_INIT(rp->functions[function.id].statements);
+	// If several functions start at the same address, the first one is found
+	if (!hashmap_get(rp->functions_by_addr, vaddr_start, &f_id))
+		hashmap_set(rp->functions_by_addr, vaddr_start, function.id);
 
 	return LIST_LENGTH(rp->functions) - 1;
 }
@@ -98,170 +272,282 @@ int rp_add_function(struct rebuilt_program *rp)
  * virtual address, if that function exists.
  */
 int rp_get_function_by_vaddr(struct rebuilt_program *rp, vmptr_t vaddr)
+{
+	int f_id;
+
+	if (hashmap_get(rp->functions_by_addr, vaddr, &f_id))
+		return f_id;
+
+	return -1;
+}
+
+/**
+ * Returns the first function with the given name, or -1. Used when symbols of
+ * the program are not loaded (cf. database.c).
+ */
+int rp_get_function_by_name(struct rebuilt_program *rp, const char *name)
 {
 	int i;
 
 	LIST_ITERATOR(rp->functions, i)
-		if (rp->functions[i].vaddr_start == vaddr)
+		if (strcmp(RP_FUNCTION_NAME(rp, &(rp->functions[i])), name) == 0)
 			return i;
 
 	return -1;
 }
 
-void rp_function_set_name(struct rebuilt_function *f, const char *name)
+/**
+ * Returns the function that the i-th statement branches to, when read as part
+ * of function f, or -1. Statements are shared by overlapping functions, but an
+ * unconditional jump only leads to another function when it ends f: this is
+ * stored in f, not in the statement.
+ */
+int rp_statement_to_function(struct rebuilt_program *rp,
+	struct rebuilt_function *f, int i)
 {
-	strncpy(f->name, name, NAMES_LENGTH - 1);
+	struct statements *st = &(rp->statements);
+	uint8_t flags = st->flags[i];
+
+	if (STATEMENT_GET_TYPE(flags) == BRANCH
+		&& STATEMENT_GET_BR_TYPE(flags) == JUMP
+		&& STATEMENT_GET_COND(flags) == UNCONDITIONAL)
+		return st->addr[i] == f->tail_jump ? f->tail_function : -1;
+
+	return st->to_function[i];
 }
 
-void rp_function_add_statement(struct rebuilt_function *f, const struct statement *s)
+void rp_function_set_name(struct rebuilt_function *f, uint32_t name)
 {
-	LIST_APPEND(f->statements, *s);
+	f->name = name;
+}
+
+/**
+ * Returns all functions sorted by start address. When several functions start
+ * at the same address, they are sorted by id. The list must be freed.
+ */
+static struct function_start *rp_sort_functions(struct rebuilt_program *rp)
+{
+	struct function_start *starts, start;
+	int i;
+
+	LIST_INIT(starts);
+	LIST_RESERVE(starts, LIST_LENGTH(rp->functions));
+	LIST_ITERATOR(rp->functions, i) {
+		start.addr = rp->functions[i].vaddr_start;
+		start.id = i;
+		LIST_APPEND(starts, start);
+	}
+	radix_sort(starts, sizeof(*starts), LIST_LENGTH(starts),
+		offsetof(struct function_start, addr));
+
+	return starts;
 }
 
 /**
  * Checks if there are some overlapping functions in the list, e.g. if two
  * functions f and g are such as f.start <= g.end and f.end > g.start.
+ * Functions are swept by start address: only the ones starting before the end
+ * of a function can overlap it.
  */
 int rp_check_overlapping_functions(struct rebuilt_program *rp)
 {
 	int ret = 0;
 	int i, j;
 	struct rebuilt_function *f, *g;
+	struct function_start *starts;
 	
 	printf(" == checking overlapping functions ==\n");
 
-	for (i = 0; i < LIST_LENGTH(rp->functions); i++) {
-		f = &(rp->functions[i]);
-		for (j = i + 1; j < LIST_LENGTH(rp->functions); j++) {
-			g = &(rp->functions[j]);
-			if (f->vaddr_end > g->vaddr_start
-				&& f->vaddr_start < g->vaddr_end) {
-				printf("overlapping functions: %s and %s\n", f->name, g->name);
+	starts = rp_sort_functions(rp);
+	LIST_ITERATOR(starts, i) {
+		f = &(rp->functions[starts[i].id]);
+		for (j = i + 1; j < LIST_LENGTH(starts)
+			&& starts[j].addr < f->vaddr_end; j++) {
+			g = &(rp->functions[starts[j].id]);
+			if (f->vaddr_start < g->vaddr_end) {
+				printf("overlapping functions: %s and %s\n",
+					RP_FUNCTION_NAME(rp, f), RP_FUNCTION_NAME(rp, g));
 				printf("\t0x%08x -> 0x%08x\tand\t0x%08x -> 0x%08x\n",
 					(int) f->vaddr_start, (int) f->vaddr_end,
 					(int) g->vaddr_start, (int) g->vaddr_end);
+				ret = 1;
 			}
 		}
 	}
+	LIST_FREE(starts);
 
 	return ret;
 }
 
+/**
+ * Trims functions so that they do not overlap: a function ends at most where
+ * the next one starts. When several functions start at the same address, the
+ * first one (by id) is kept, and the others become empty.
+ * Functions without a valid end (end <= start) are left untouched, and do not
+ * trim others that start after their end.
+ * Then, non-empty functions are put in the functions interval index.
+ */
 void rp_fix_overlapping_functions(struct rebuilt_program *rp)
 {
-	int i, j;
+	int i, j, next;
 	struct rebuilt_function *f, *g;
+	struct function_start *starts;
+
+	starts = rp_sort_functions(rp);
+	LIST_LENGTH(rp->functions_index) = 0;
+
+	for (i = 0, next = 0; i < LIST_LENGTH(starts); i = next) {
+		// Functions from i to next - 1 start at the same address
+		for (next = i + 1; next < LIST_LENGTH(starts)
+			&& starts[next].addr == starts[i].addr; next++) ;
+
+		f = NULL;
+		for (j = i; j < next; j++) {
+			g = &(rp->functions[starts[j].id]);
+			if (g->vaddr_end <= g->vaddr_start)
+				continue;
+			if (f == NULL)
+				f = g;
+			else
+				g->vaddr_end = g->vaddr_start;
+		}
+		if (f == NULL)
+			continue;
 
-	for (i = 0; i < LIST_LENGTH(rp->functions); i++) {
-		f = &(rp->functions[i]);
-		for (j = i + 1; j < LIST_LENGTH(rp->functions); j++) {
-			g = &(rp->functions[j]);
-			if (f->vaddr_end > g->vaddr_start
-				&& f->vaddr_start < g->vaddr_end) {
-				// One of these functions needs to be fixed
-				/*if (f->vaddr_end != g->vaddr_end) {
-					FATAL_ERROR("cannot fix overlapping functions %s and %s",
-						f->name, g->name);
-				} else*/ if (f->vaddr_start < g->vaddr_start) {
-					f->vaddr_end = g->vaddr_start;
-				} else {
-					g->vaddr_end = f->vaddr_start;
-				}
+		// End the function where the next one starts
+		for (j = next; j < LIST_LENGTH(starts)
+			&& starts[j].addr < f->vaddr_end; j++) {
+			g = &(rp->functions[starts[j].id]);
+			if (g->vaddr_end > f->vaddr_start) {
+				f->vaddr_end = g->vaddr_start;
+				break;
 			}
 		}
+
+		LIST_APPEND(rp->functions_index, starts[i]);
+		rp->functions_index[LIST_LENGTH(rp->functions_index) - 1].id = f->id;
 	}
+
+	LIST_FREE(starts);
+}
+
+/**
+ * Returns the function containing a given address, using the functions
+ * interval index, or -1 if there is none.
+ */
+int rp_get_function_containing(struct rebuilt_program *rp, vmptr_t addr)
+{
+	int low = 0, high = LIST_LENGTH(rp->functions_index), middle;
+
+	// Find the last function starting at or before addr
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (rp->functions_index[middle].addr <= addr)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low == 0)
+		return -1;
+
+	if (rp->functions[rp->functions_index[low - 1].id].vaddr_end <= addr)
+		return -1;
+	return rp->functions_index[low - 1].id;
 }
 
 /**
  * Displays one function, very compactly: start and end addresses.
  */
-void rp_dump_function_very_compact(struct rebuilt_program *rp,
+void rp_dump_function_very_compact(struct rebuilt_program *rp, FILE *out,
 	struct rebuilt_function *f)
 {
-	printf("0x%08x\t0x%08x\n", (int) f->vaddr_start, (int) f->vaddr_end);
+	fprintf(out, "0x%08x\t0x%08x\n", (int) f->vaddr_start, (int) f->vaddr_end);
 }
 
 /**
  * Displays one function, compactly: addresses and childs, on one line.
  */
-void rp_dump_function_compact(struct rebuilt_program *rp,
+void rp_dump_function_compact(struct rebuilt_program *rp, FILE *out,
 	struct rebuilt_function *f)
 {
-	int j;
-	struct statement *s;
-	int *already_done_f;
+	int j, to_function;
+	struct hashset *already_done_f;
 	int first_child = 1;
 
-	printf("%s\t0x%08x\t0x%08x\t", f->name, (int) f->vaddr_start,
+	fprintf(out, "%s\t0x%08x\t0x%08x\t", RP_FUNCTION_NAME(rp, f),
+		(int) f->vaddr_start,
 		(int) f->vaddr_end);
 
-	LIST_INIT(already_done_f);
-	LIST_ITERATOR(f->statements, j) {
-		s = &(f->statements[j]);
-
+	already_done_f = hashset_init();
+	RP_FUNCTION_ITERATOR(rp, f, j) {
 		// Dump child functions
-		if (s->type == BRANCH && s->to_function != -1) {
-			LIST_IFNOT_CONTAINS(already_done_f, s->to_function) {
+		if (STATEMENT_GET_TYPE(rp->statements.flags[j]) != BRANCH)
+			continue;
+		to_function = rp_statement_to_function(rp, f, j);
+		if (to_function != -1) {
+			if (hashset_add(already_done_f, to_function)) {
 				if (!first_child)
-					printf(",");
-				printf("%s", rp->functions[s->to_function].name);
-				LIST_APPEND(already_done_f, s->to_function);
+					fprintf(out, ",");
+				fprintf(out, "%s", RP_FUNCTION_NAME(rp,
+					&(rp->functions[to_function])));
 				first_child = 0;
 			}
 		}
 	}
-	LIST_FREE(already_done_f);
+	hashset_free(already_done_f);
 
-	printf("\n");
+	fprintf(out, "\n");
 }
 
 /**
  * Displays one function, with all info: addresses and all inner statements.
  */
-void rp_dump_function_debug(struct rebuilt_program *rp,
+void rp_dump_function_debug(struct rebuilt_program *rp, FILE *out,
 	struct rebuilt_function *f)
 {
-	int j;
-	struct statement *s;
+	int j, to_function;
+	struct statement stm, *s = &stm;
 
-	printf("%s%s\n", f->name, f->from_stdlib?" (stdlib)":"");
-	printf("\t%05x {\n", (int) f->vaddr_start);
+	fprintf(out, "%s%s\n", RP_FUNCTION_NAME(rp, f), f->from_stdlib?" (stdlib)":"");
+	fprintf(out, "\t%05x {\n", (int) f->vaddr_start);
 	// Dump statements
-	LIST_ITERATOR(f->statements, j) {
-		s = &(f->statements[j]);
+	RP_FUNCTION_ITERATOR(rp, f, j) {
+		statements_get(&(rp->statements), j, s);
 		if (s->type == BRANCH) {
-			printf("\t%05x   BRANCH (%s)  %s  %s", (int) s->addr,
+			fprintf(out, "\t%05x   BRANCH (%s)  %s  %s", (int) s->addr,
 				STATEMENT_BR_TYPE(s->br_type),
 				STATEMENT_COND(s->cond), STATEMENT_STATICITY(s->staticity));
 			if (s->to_addr != 0)
-				printf("  -> %05x", s->to_addr);
-			if (s->to_function != -1)
-				printf(" (%s)", rp->functions[s->to_function].name);
-			printf("\n");
+				fprintf(out, "  -> %05x", s->to_addr);
+			to_function = rp_statement_to_function(rp, f, j);
+			if (to_function != -1)
+				fprintf(out, " (%s)", RP_FUNCTION_NAME(rp,
+					&(rp->functions[to_function])));
+			fprintf(out, "\n");
 		} else if (s->type == WORD) {
-			printf("\t%05x   WORD     %08x\n", (int) s->addr, s->value);
+			fprintf(out, "\t%05x   WORD     %08x\n", (int) s->addr, s->value);
 		} else if (s->type == SYSCALL) {
-			printf("\t%05x   SYSCALL  #%d (%s)\n", (int) s->addr,
+			fprintf(out, "\t%05x   SYSCALL  #%d (%s)\n", (int) s->addr,
 				s->value, arm_syscall_name(s->value));
 		}
 	}
-	printf("\t%05x }\n", (int) f->vaddr_end);
+	fprintf(out, "\t%05x }\n", (int) f->vaddr_end);
 }
 
 /**
  * Displays all functions in the rebuilt_program's list.
  */
-void rp_dump_functions(struct rebuilt_program *rp, int hide_stdlib,
-	int compacity)
+void rp_dump_functions(struct rebuilt_program *rp, FILE *out,
+	int hide_stdlib, int compacity)
 {
 	int i;
 	struct rebuilt_function *f;
 
-	/*printf(" == program entry point ==\n"
+	/*fprintf(out, " == program entry point ==\n"
 		"function %s @ %05x\n",
-		(char *) rp->functions[rp->entry_function].name,
+		RP_FUNCTION_NAME(rp, &(rp->functions[rp->entry_function])),
 		(int) rp->functions[rp->entry_function].vaddr_start);
-	printf(" == dumping functions ==\n"
+	fprintf(out, " == dumping functions ==\n"
 		"%d elements%s\n", LIST_LENGTH(rp->functions),
 		hide_stdlib==STDLIB_HIDE?" (stdlib hidden)":"");*/
 
@@ -271,19 +557,19 @@ void rp_dump_functions(struct rebuilt_program *rp, int hide_stdlib,
 			continue;
 
 		if (compacity >= 2)
-			rp_dump_function_very_compact(rp, f);
+			rp_dump_function_very_compact(rp, out, f);
 		else if (compacity == 1)
-			rp_dump_function_compact(rp, f);
+			rp_dump_function_compact(rp, out, f);
 		else
-			rp_dump_function_debug(rp, f);
+			rp_dump_function_debug(rp, out, f);
 	}
 }
 
 /**
  * Displays one particuliar function from its start address.
  */
-void rp_dump_function_by_addr(struct rebuilt_program *rp, vmptr_t addr,
-	int compacity)
+void rp_dump_function_by_addr(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr, int compacity)
 {
 	int i;
 	struct rebuilt_function *f;
@@ -293,15 +579,60 @@ void rp_dump_function_by_addr(struct rebuilt_program *rp, vmptr_t addr,
 
 		if (f->vaddr_start == addr) {
 			if (compacity >= 2)
-				rp_dump_function_very_compact(rp, f);
+				rp_dump_function_very_compact(rp, out, f);
 			else if (compacity == 1)
-				rp_dump_function_compact(rp, f);
+				rp_dump_function_compact(rp, out, f);
 			else
-				rp_dump_function_debug(rp, f);
+				rp_dump_function_debug(rp, out, f);
 			return;
 		}
 	}
-	printf("error: function at address 0x%x not found\n", (int) addr);
+	fprintf(out, "error: function at address 0x%x not found\n", (int) addr);
+}
+
+/**
+ * Displays compactly the function containing an address. Returns 0, or -1 if
+ * no function contains it.
+ */
+int rp_dump_function_containing(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr)
+{
+	int f_id = rp_get_function_containing(rp, addr);
+
+	if (f_id < 0)
+		return -1;
+	rp_dump_function_compact(rp, out, &(rp->functions[f_id]));
+
+	return 0;
+}
+
+/**
+ * Displays compactly the functions of a rebuilt_program that do not start at
+ * the same address as any function of another one (e.g. built by another mode
+ * of decompilation), sorted by address. Returns how many there are.
+ */
+int rp_dump_functions_missing(struct rebuilt_program *rp, FILE *out,
+	struct rebuilt_program *other, int hide_stdlib)
+{
+	int i, count = 0;
+	struct rebuilt_function *f;
+	struct function_start *starts;
+
+	starts = rp_sort_functions(rp);
+	LIST_ITERATOR(starts, i) {
+		f = &(rp->functions[starts[i].id]);
+		// Functions starting at the same address are only shown once
+		if (rp_get_function_by_vaddr(rp, f->vaddr_start) != f->id
+			|| rp_get_function_by_vaddr(other, f->vaddr_start) != -1)
+			continue;
+		if (hide_stdlib == STDLIB_HIDE && f->from_stdlib)
+			continue;
+		rp_dump_function_compact(rp, out, f);
+		count++;
+	}
+	LIST_FREE(starts);
+
+	return count;
 }
 
 /**
@@ -309,16 +640,21 @@ void rp_dump_function_by_addr(struct rebuilt_program *rp, vmptr_t addr,
  * GraphViz. This is a callgraph, so nodes are functions, and oriented edges
  * represent calls from one function to another.
  */
-void rp_dump_callgraph(struct rebuilt_program *rp, int hide_stdlib)
+void rp_dump_callgraph(struct rebuilt_program *rp, FILE *out,
+	int hide_stdlib)
 {
-	int i, j;
+	int i, j, k, to_function;
 	struct rebuilt_function *f;
-	struct statement *s;
+	struct statements *st = &(rp->statements);
+	uint32_t value;
 
-	int *already_done_f;
-	uint32_t *already_done_s;
+	struct hashset *already_done_f;
+	struct hashset *already_done_s;
 
-	printf("digraph G {\n");
+	fprintf(out, "digraph G {\n");
+
+	already_done_f = hashset_init();
+	already_done_s = hashset_init();
 
 	// Dump functions names
 	LIST_ITERATOR(rp->functions, i) {
@@ -326,50 +662,37 @@ void rp_dump_callgraph(struct rebuilt_program *rp, int hide_stdlib)
 		if (hide_stdlib == STDLIB_HIDE && f->from_stdlib)
 			continue;
 
-		printf("\tF%d [label=\"%s\"];\n", i, f->name);
-
-		LIST_INIT(already_done_f);
-		LIST_INIT(already_done_s);
-		LIST_ITERATOR(f->statements, j) {
-			s = &(f->statements[j]);
+		fprintf(out, "\tF%d [label=\"%s\"];\n", i, RP_FUNCTION_NAME(rp, f));
 
+		hashset_clear(already_done_f);
+		hashset_clear(already_done_s);
+		k = 0; // rank of the statement in the function
+		RP_FUNCTION_ITERATOR(rp, f, j) {
 			// Dump child functions
-			if (s->type == BRANCH) {
-				if (s->to_function != -1) {
-					LIST_IFNOT_CONTAINS(already_done_f, s->to_function) {
-						printf("\tF%d -> F%d;\n", i, s->to_function);
-						LIST_APPEND(already_done_f, s->to_function);
-					}
+			if (STATEMENT_GET_TYPE(st->flags[j]) == BRANCH) {
+				to_function = rp_statement_to_function(rp, f, j);
+				if (to_function != -1) {
+					if (hashset_add(already_done_f, to_function))
+						fprintf(out, "\tF%d -> F%d;\n", i, to_function);
 				}
 			// Dump syscalls
-			} else if (s->type == SYSCALL) {
-				LIST_IFNOT_CONTAINS(already_done_s, s->value) {
-					printf("\tS%d_%d [label=\"syscall #%d\\n%s\", shape=box, "\
-						"style=filled, fillcolor=gray50];\n" , i, j,
-						s->value, arm_syscall_name(s->value));
-					printf("\tF%d -> S%d_%d;\n", i, i, j);
-					LIST_APPEND(already_done_s, s->value);
+			} else if (STATEMENT_GET_TYPE(st->flags[j]) == SYSCALL) {
+				value = st->value[j];
+				if (hashset_add(already_done_s, value)) {
+					fprintf(out, "\tS%d_%d [label=\"syscall #%d\\n%s\", shape=box, "\
+						"style=filled, fillcolor=gray50];\n" , i, k,
+						value, arm_syscall_name(value));
+					fprintf(out, "\tF%d -> S%d_%d;\n", i, i, k);
 				}
 			}
+			k++;
 		}
-		LIST_FREE(already_done_f);
-		LIST_FREE(already_done_s);
 	}
 
-	printf("}\n");
-}
+	hashset_free(already_done_f);
+	hashset_free(already_done_s);
 
-/**
- * Function to compare two statements by their address.
- * This is used by the sorting algorithm.
- */
-static int cmp_cfg_addr(const void *a, const void *b)
-{
-	struct cfg_node *A = (struct cfg_node *) a,
-	                *B = (struct cfg_node *) b;
-	if (A->addr == B->addr)
-		return A->type - B->type;
-	return A->addr - B->addr;
+	fprintf(out, "}\n");
 }
 
 /**
@@ -377,12 +700,13 @@ static int cmp_cfg_addr(const void *a, const void *b)
  * readable by GraphViz.
  * More info on CFGs on: http://en.wikipedia.org/wiki/Control_flow_graph
  */
-void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
+void rp_dump_cfg_for_function(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr)
 {
-	int i, j;
+	int i, j, to_function;
 	struct rebuilt_function *f = NULL;
 
-	struct statement *s;
+	struct statement stm, *s = &stm;
 
 	struct cfg_node *nodes, *n;
 	struct cfg_node node;
@@ -395,21 +719,23 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 		}
 	}
 	if (f == NULL) {
-		printf("error: function at address 0x%x not found\n", (int) addr);
+		fprintf(out, "error: function at address 0x%x not found\n", (int) addr);
 		return;
 	}
 
 	LIST_INIT(nodes);
+	// Each statement gives at most 3 nodes, plus entry and exit nodes
+	LIST_RESERVE(nodes, 3 * f->statements_count + 2);
 
 	// Step 1: Determine all nodes
-	node.stm = NULL;
+	node.stm = -1;
 	node.show = YES;
 	// Add entry node
 	node.addr = f->vaddr_start;
 	node.type = NODE;
 	LIST_APPEND(nodes, node);
-	LIST_ITERATOR(f->statements, i) {
-		s = &(f->statements[i]);
+	RP_FUNCTION_ITERATOR(rp, f, i) {
+		statements_get(&(rp->statements), i, s);
 		if (s->type == BRANCH && s->br_type == JUMP) {
 			// Add the statement itself
 			node.addr = s->addr;
@@ -462,8 +788,12 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 	node.type = NODE;
 	LIST_APPEND(nodes, node);
 
-	// Step 2: sort them by address, and remove doubles
-	merge_sort(nodes, sizeof(*nodes), LIST_LENGTH(nodes), cmp_cfg_addr);
+	// Step 2: sort them by address then by type (the sort is stable, so sort
+	// by type first), and remove doubles
+	radix_sort(nodes, sizeof(*nodes), LIST_LENGTH(nodes),
+		offsetof(struct cfg_node, type));
+	radix_sort(nodes, sizeof(*nodes), LIST_LENGTH(nodes),
+		offsetof(struct cfg_node, addr));
 	LIST_ITERATOR(nodes, i) {
 		if (i == LIST_LENGTH(nodes) - 1)
 			break;
@@ -475,13 +805,14 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 	}
 
 	// Step 3: match each cfg_node with its statement, if it exists
-	LIST_ITERATOR(f->statements, i) {
-		s = &(f->statements[i]);
+	RP_FUNCTION_ITERATOR(rp, f, i) {
 		j = 0;
-		while (j < LIST_LENGTH(nodes) && nodes[j].addr < s->addr)
+		while (j < LIST_LENGTH(nodes)
+			&& nodes[j].addr < rp->statements.addr[i])
 			j++;
-		while (j < LIST_LENGTH(nodes) && nodes[j].addr == s->addr) {
-			nodes[j].stm = s;
+		while (j < LIST_LENGTH(nodes)
+			&& nodes[j].addr == rp->statements.addr[i]) {
+			nodes[j].stm = i;
 			j++;
 		}
 	}
@@ -489,14 +820,14 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 	// Step 4: Make edges
 	LIST_ITERATOR(nodes, i) {
 		n = &nodes[i];
-		s = n->stm;
 
 		n->child1 = n->child2 = -1;
 
 		// Make standard edges for branches
 		if (n->type == NODE && n->addr == f->vaddr_end) {
 			continue;
-		} else if (s != NULL) {
+		} else if (n->stm != -1) {
+			statements_get(&(rp->statements), n->stm, s);
 			if ((s->cond == CONDITIONAL || n->type == SYSFUNCTION
 				|| n->type == FUNCTION) && !(n->type == FUNCTION &&
 				s->type == BRANCH && s->br_type == JUMP)) {
@@ -599,7 +930,7 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 	}
 
 	// Step 6: Output graph
-	printf("digraph G {\n");
+	fprintf(out, "digraph G {\n");
 
 	LIST_ITERATOR(nodes, i) {
 		n = &nodes[i];
@@ -609,38 +940,41 @@ void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr)
 
 		// Display this node
 		if (n->type == NODE) {
-			printf("\tN_%d_%x ", n->type, n->addr);
+			fprintf(out, "\tN_%d_%x ", n->type, n->addr);
 			if (n->addr == f->vaddr_start)
-				printf("[label=\"ENTRY\\n0x%x\"];\n", n->addr);
+				fprintf(out, "[label=\"ENTRY\\n0x%x\"];\n", n->addr);
 			else if (n->addr == f->vaddr_end)
-				printf("[label=\"EXIT\\n0x%x\"];\n", n->addr);
+				fprintf(out, "[label=\"EXIT\\n0x%x\"];\n", n->addr);
 			else
-				printf("[label=\"0x%x\"];\n", n->addr);
+				fprintf(out, "[label=\"0x%x\"];\n", n->addr);
 		} else if (n->type == FUNCTION) {
-			if (n->stm != NULL)
-				printf("\tN_%d_%x [label=\"%s\", shape=box, style=filled, "\
+			if (n->stm != -1) {
+				to_function = rp_statement_to_function(rp, f, n->stm);
+				fprintf(out, "\tN_%d_%x [label=\"%s\", shape=box, style=filled, "\
 					"fillcolor=gray75];\n", n->type, n->addr,
-					n->stm->to_function >= 0 ?
-					rp->functions[n->stm->to_function].name : "?");
-			else
-				printf("\tN_%d_%x [label=\"%s\", shape=box, style=filled, "\
+					to_function >= 0 ?
+					RP_FUNCTION_NAME(rp,
+					&(rp->functions[to_function])) : "?");
+			} else
+				fprintf(out, "\tN_%d_%x [label=\"%s\", shape=box, style=filled, "\
 					"fillcolor=gray75];\n", n->type, n->addr, "?");
 		} else if (n->type == SYSFUNCTION) {
-			printf("\tN_%d_%x [label=\"syscall #%d\\n%s\", shape=box, "\
+			fprintf(out, "\tN_%d_%x [label=\"syscall #%d\\n%s\", shape=box, "\
 				"style=filled, fillcolor=gray50];\n", n->type, n->addr,
-				n->stm->value, arm_syscall_name(n->stm->value));
+				rp->statements.value[n->stm],
+				arm_syscall_name(rp->statements.value[n->stm]));
 		}
 
 		// Display edges from this node
 		if (n->child1 >= 0)
-			printf("\tN_%d_%x -> N_%d_%x;\n", n->type, n->addr,
+			fprintf(out, "\tN_%d_%x -> N_%d_%x;\n", n->type, n->addr,
 				nodes[n->child1].type, nodes[n->child1].addr);
 		if (n->child2 >= 0)
-			printf("\tN_%d_%x -> N_%d_%x;\n", n->type, n->addr,
+			fprintf(out, "\tN_%d_%x -> N_%d_%x;\n", n->type, n->addr,
 				nodes[n->child2].type, nodes[n->child2].addr);
 	}
 
-	printf("}\n");
+	fprintf(out, "}\n");
 
 	LIST_FREE(nodes);
 }
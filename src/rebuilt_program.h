@@ -31,8 +31,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "bitmaps.h"
+#include "arena.h"
 #include "common.h"
 #include "groups.h"
+#include "hashsets.h"
+#include "strtab.h"
 #include "vm.h"
 
 #include "rebuilt_program.h"
@@ -62,49 +66,122 @@ struct statement {
 
 void statement_dump(struct statement* s);
 
+/**
+ * Statements of a program. They are stored as parallel lists, one per field,
+ * instead of a list of struct statement: passes over the statements mostly
+ * read addresses and types, which are then packed together. The enums of a
+ * statement are packed in one flags byte.
+ */
+struct statements {
+	vmptr_t *addr;
+	vmptr_t *to_addr;
+	uint32_t *value;
+	int *to_function;
+	uint8_t *flags;
+};
+
+#define STATEMENT_FLAGS(_type, _cond, _br_type, _staticity)	\
+	((uint8_t) ((_type) | (_cond) << 3 | (_br_type) << 4 | (_staticity) << 6))
+#define STATEMENT_GET_TYPE(_flags)	((_flags) & 0x7)
+#define STATEMENT_GET_COND(_flags)	(((_flags) >> 3) & 0x1)
+#define STATEMENT_GET_BR_TYPE(_flags)	(((_flags) >> 4) & 0x3)
+#define STATEMENT_GET_STATICITY(_flags)	(((_flags) >> 6) & 0x3)
+
+#define STATEMENTS_LENGTH(_st)	\
+	LIST_LENGTH((_st)->addr)
+
+void statements_init(struct statements *st, struct arena *arena);
+void statements_reserve(struct statements *st, int capacity);
+void statements_append(struct statements *st, struct statement *s);
+void statements_get(struct statements *st, int i, struct statement *s);
+void statements_swap(struct statements *st, int i, int j);
+void statements_remove(struct statements *st, int i);
+void statements_sort(struct statements *st);
+
 struct rebuilt_function {
 	int id;
 	vmptr_t vaddr_start;
 	vmptr_t vaddr_end;
-	char name[NAMES_LENGTH];
-	struct statement *statements;
+	uint32_t name; // offset in the program's strings table
+	int first_statement; // the function's statements are a span of the
+	int statements_count; // program's ones (cf. RP_FUNCTION_ITERATOR)
+	vmptr_t tail_jump; // address of the jump ending the function, if any,
+	int tail_function; // and function it jumps to (or -1)
 	int from_stdlib;
 };
 
+/**
+ * Entry of the functions interval index: once overlapping functions are fixed,
+ * non-empty functions are disjoint, and sorted by start address here.
+ */
+struct function_start {
+	vmptr_t addr;
+	int id;
+};
+
 struct rebuilt_program {
-	struct statement *statements;
+	struct arena *arena; // owns all lists below
+	struct statements statements;
 	struct group *explored;
+	struct bitmap *explored_map;
+	struct hashset *words; // addresses of WORD statements
 	struct rebuilt_function *functions;
+	struct hashset *functions_by_addr; // start address -> function id
+	struct function_start *functions_index;
 	int entry_function;
+	struct strtab *strings; // names of functions, shared with the vm_program
 };
 
+#define RP_FUNCTION_NAME(_rp, _f)	\
+	strtab_get((_rp)->strings, (_f)->name)
+
+/**
+ * Iterates over the statements of a function, which are the ones of the
+ * program from the function's start to its end. Words are not part of a
+ * function: they are skipped.
+ */
+#define RP_FUNCTION_ITERATOR(_rp, _f, _i)	\
+	for (_i = (_f)->first_statement;\
+		_i < (_f)->first_statement + (_f)->statements_count; _i++)\
+		if (STATEMENT_GET_TYPE((_rp)->statements.flags[_i]) != WORD\
+			&& STATEMENT_GET_TYPE((_rp)->statements.flags[_i]) != NOP)
+
 struct rebuilt_program *rp_new();
 void rp_free(struct rebuilt_program *rp);
+void rp_reset(struct rebuilt_program *rp);
 
-int rp_add_function(struct rebuilt_program *rp);
+int rp_add_function(struct rebuilt_program *rp, vmptr_t vaddr_start);
 int rp_get_function_by_vaddr(struct rebuilt_program *rp, vmptr_t vaddr);
+int rp_get_function_by_name(struct rebuilt_program *rp, const char *name);
+int rp_statement_to_function(struct rebuilt_program *rp,
+	struct rebuilt_function *f, int i);
 
-void rp_function_add_statement(struct rebuilt_function *f,
-	const struct statement *s);
-void rp_function_set_name(struct rebuilt_function *f, const char *name);
+void rp_function_set_name(struct rebuilt_function *f, uint32_t name);
 
 int rp_check_overlapping_functions(struct rebuilt_program *rp);
 void rp_fix_overlapping_functions(struct rebuilt_program *rp);
+int rp_get_function_containing(struct rebuilt_program *rp, vmptr_t addr);
 
-void rp_dump_functions(struct rebuilt_program *rp, int hide_stdlib,
-	int compacity);
-void rp_dump_function_by_addr(struct rebuilt_program *rp, vmptr_t addr,
-	int compacity);
+void rp_dump_functions(struct rebuilt_program *rp, FILE *out,
+	int hide_stdlib, int compacity);
+void rp_dump_function_by_addr(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr, int compacity);
+int rp_dump_function_containing(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr);
+int rp_dump_functions_missing(struct rebuilt_program *rp, FILE *out,
+	struct rebuilt_program *other, int hide_stdlib);
 
 struct cfg_node {
 	vmptr_t addr;
 	enum { NODE, FUNCTION, SYSFUNCTION } type;
-	struct statement *stm;
+	int stm; // index of the statement, or -1
 	int child1, child2;
 	enum { NO, YES } show;
 };
 
-void rp_dump_callgraph(struct rebuilt_program *rp, int hide_stdlib);
-void rp_dump_cfg_for_function(struct rebuilt_program *rp, vmptr_t addr);
+void rp_dump_callgraph(struct rebuilt_program *rp, FILE *out,
+	int hide_stdlib);
+void rp_dump_cfg_for_function(struct rebuilt_program *rp, FILE *out,
+	vmptr_t addr);
 
 #endif
@@ -0,0 +1,295 @@
+/**
+ * @file    scanner.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a scanner that classifies all words of the executable
+ * sections of a program at once, by comparing them to patterns several at a
+ * time (cf. scanner.h).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "common.h"
+#include "scanner.h"
+
+/**
+ * A word is in a class if (word & mask) == value, except if
+ * (word & except_mask) == except_value (when except_mask is not 0).
+ * c.f. ARM Architecture Reference Manual, figure A3-1, and arm_instr_decode().
+ */
+struct scanner_pattern {
+	int class;
+	uint32_t mask, value;
+	uint32_t except_mask, except_value;
+};
+
+static const struct scanner_pattern scanner_patterns[] = {
+	// B, BL, BLX(1)
+	{ SCANNER_BRANCH, 0x0e000000, 0x0a000000, 0, 0 },
+	// BX, BXJ, BLX(2)
+	{ SCANNER_BRANCH, 0x0fe000c0, 0x01200000, 0x0fe000f0, 0x01200000 },
+	// Data processing writing to PC, except TST, TEQ, CMP and CMN
+	{ SCANNER_BRANCH, 0x0c00f000, 0x0000f000, 0x0d80f000, 0x0100f000 },
+	// Load to PC
+	{ SCANNER_BRANCH, 0x0c10f000, 0x0410f000, 0, 0 },
+	// Load multiple, including PC
+	{ SCANNER_BRANCH, 0x0e108000, 0x08108000, 0, 0 },
+	// BL, BLX(1), BLX(2)
+	{ SCANNER_LINK, 0x0f000000, 0x0b000000, 0, 0 },
+	{ SCANNER_LINK, 0xfe000000, 0xfa000000, 0, 0 },
+	{ SCANNER_LINK, 0x0ff000f0, 0x01200030, 0, 0 },
+	// Software interrupt
+	{ SCANNER_SYSCALL, 0x0f000000, 0x0f000000, 0, 0 },
+	// ldr rd, [pc, #+imm]
+	{ SCANNER_LOAD_STATIC, 0x0fff0000, 0x059f0000, 0, 0 },
+	// mov lr, pc
+	{ SCANNER_MOV_LR_PC, 0xffffffff, 0xe1a0e00f, 0, 0 },
+	// stmfd sp!, {..., lr} and str lr, [sp, #-4]!
+	{ SCANNER_PROLOGUE, 0xffff4000, 0xe92d4000, 0, 0 },
+	{ SCANNER_PROLOGUE, 0xffffffff, 0xe52de004, 0, 0 },
+};
+
+#define SCANNER_PATTERNS	\
+	((int) (sizeof(scanner_patterns) / sizeof(scanner_patterns[0])))
+
+/**
+ * Classifies blocks of 64 words: sets bit i of bits[class][block] if word i
+ * of the block is in the class. The last block may be partial: it has count
+ * words.
+ */
+static void scanner_scan_scalar(const uint32_t *words, size_t blocks,
+	int count, uint64_t **bits)
+{
+	const struct scanner_pattern *pattern;
+	uint64_t found[SCANNER_CLASSES];
+	size_t block;
+	int i, n, p;
+
+	for (block = 0; block < blocks; block++, words += 64) {
+		memset(found, 0, sizeof(found));
+		n = block == blocks - 1 ? count : 64;
+		for (i = 0; i < n; i++) {
+			for (p = 0; p < SCANNER_PATTERNS; p++) {
+				pattern = &(scanner_patterns[p]);
+				if ((words[i] & pattern->mask) == pattern->value
+					&& (pattern->except_mask == 0
+					|| (words[i] & pattern->except_mask)
+						!= pattern->except_value))
+					found[pattern->class] |= (uint64_t) 1 << i;
+			}
+		}
+		for (p = 0; p < SCANNER_CLASSES; p++)
+			bits[p][block] = found[p];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void scanner_scan_sse2(const uint32_t *words, size_t blocks,
+	int count, uint64_t **bits)
+{
+	__m128i masks[SCANNER_PATTERNS], values[SCANNER_PATTERNS];
+	__m128i except_masks[SCANNER_PATTERNS], except_values[SCANNER_PATTERNS];
+	uint64_t found[SCANNER_CLASSES];
+	__m128i w, m, acc;
+	size_t block;
+	int i, p;
+
+	for (p = 0; p < SCANNER_PATTERNS; p++) {
+		masks[p] = _mm_set1_epi32(scanner_patterns[p].mask);
+		values[p] = _mm_set1_epi32(scanner_patterns[p].value);
+		except_masks[p] = _mm_set1_epi32(scanner_patterns[p].except_mask);
+		except_values[p] = _mm_set1_epi32(scanner_patterns[p].except_value);
+	}
+
+	// The last block is left to the scalar version
+	for (block = 0; block < blocks - 1; block++, words += 64) {
+		memset(found, 0, sizeof(found));
+		for (i = 0; i < 64; i += 4) {
+			w = _mm_loadu_si128((const __m128i *) (words + i));
+			acc = _mm_setzero_si128();
+// Unrolled, so that the pattern table is folded into the code
+#pragma GCC unroll 16
+			for (p = 0; p < SCANNER_PATTERNS; p++) {
+				m = _mm_cmpeq_epi32(_mm_and_si128(w, masks[p]), values[p]);
+				if (scanner_patterns[p].except_mask != 0)
+					m = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(w,
+						except_masks[p]), except_values[p]), m);
+				acc = _mm_or_si128(acc, m);
+				// Patterns are sorted by class
+				if (p == SCANNER_PATTERNS - 1 || scanner_patterns[p + 1].class
+						!= scanner_patterns[p].class) {
+					found[scanner_patterns[p].class] |= (uint64_t)
+						_mm_movemask_ps(_mm_castsi128_ps(acc)) << i;
+					acc = _mm_setzero_si128();
+				}
+			}
+		}
+		for (p = 0; p < SCANNER_CLASSES; p++)
+			bits[p][block] = found[p];
+	}
+
+	for (p = 0; p < SCANNER_CLASSES; p++)
+		bits[p] += block;
+	scanner_scan_scalar(words, 1, count, bits);
+	for (p = 0; p < SCANNER_CLASSES; p++)
+		bits[p] -= block;
+}
+
+__attribute__((target("avx2")))
+static void scanner_scan_avx2(const uint32_t *words, size_t blocks,
+	int count, uint64_t **bits)
+{
+	__m256i masks[SCANNER_PATTERNS], values[SCANNER_PATTERNS];
+	__m256i except_masks[SCANNER_PATTERNS], except_values[SCANNER_PATTERNS];
+	uint64_t found[SCANNER_CLASSES];
+	__m256i w, m, acc;
+	size_t block;
+	int i, p;
+
+	for (p = 0; p < SCANNER_PATTERNS; p++) {
+		masks[p] = _mm256_set1_epi32(scanner_patterns[p].mask);
+		values[p] = _mm256_set1_epi32(scanner_patterns[p].value);
+		except_masks[p] = _mm256_set1_epi32(scanner_patterns[p].except_mask);
+		except_values[p] = _mm256_set1_epi32(scanner_patterns[p].except_value);
+	}
+
+	// The last block is left to the scalar version
+	for (block = 0; block < blocks - 1; block++, words += 64) {
+		memset(found, 0, sizeof(found));
+		for (i = 0; i < 64; i += 8) {
+			w = _mm256_loadu_si256((const __m256i *) (words + i));
+			acc = _mm256_setzero_si256();
+// Unrolled, so that the pattern table is folded into the code
+#pragma GCC unroll 16
+			for (p = 0; p < SCANNER_PATTERNS; p++) {
+				m = _mm256_cmpeq_epi32(_mm256_and_si256(w, masks[p]),
+					values[p]);
+				if (scanner_patterns[p].except_mask != 0)
+					m = _mm256_andnot_si256(_mm256_cmpeq_epi32(
+						_mm256_and_si256(w, except_masks[p]),
+						except_values[p]), m);
+				acc = _mm256_or_si256(acc, m);
+				// Patterns are sorted by class
+				if (p == SCANNER_PATTERNS - 1 || scanner_patterns[p + 1].class
+						!= scanner_patterns[p].class) {
+					found[scanner_patterns[p].class] |= (uint64_t)
+						_mm256_movemask_ps(_mm256_castsi256_ps(acc)) << i;
+					acc = _mm256_setzero_si256();
+				}
+			}
+		}
+		for (p = 0; p < SCANNER_CLASSES; p++)
+			bits[p][block] = found[p];
+	}
+
+	for (p = 0; p < SCANNER_CLASSES; p++)
+		bits[p] += block;
+	scanner_scan_scalar(words, 1, count, bits);
+	for (p = 0; p < SCANNER_CLASSES; p++)
+		bits[p] -= block;
+}
+#endif
+
+/**
+ * Classifies all words of a section, and marks the skippable ones.
+ */
+static void scanner_scan_section(struct scanner *scanner, int s,
+	void (*scan)(const uint32_t *, size_t, int, uint64_t **))
+{
+	struct vm_elf_section *section = &(scanner->program->sections[s]);
+	size_t words = section->size / 4, blocks, block;
+	uint64_t *bits[SCANNER_CLASSES], *skippable;
+	int c, count;
+
+	if (words == 0)
+		return;
+	blocks = (words + 63) / 64;
+	count = words - (blocks - 1) * 64;
+
+	for (c = 0; c < SCANNER_CLASSES; c++)
+		bits[c] = scanner->classes[c]->sections[s].bits;
+	scan(section->map_addr, blocks, count, bits);
+
+	skippable = scanner->skippable->sections[s].bits;
+	for (block = 0; block < blocks; block++)
+		skippable[block] = ~(bits[SCANNER_BRANCH][block]
+			| bits[SCANNER_SYSCALL][block] | bits[SCANNER_LOAD_STATIC][block]);
+	// Words after the last whole one are not skippable
+	if (count < 64)
+		skippable[blocks - 1] &= ((uint64_t) 1 << count) - 1;
+}
+
+/**
+ * Creates a scanner, and classifies all words of the executable sections of a
+ * program, with the fastest implementation the processor supports.
+ */
+struct scanner *scanner_init(struct vm_program *program)
+{
+	struct scanner *scanner;
+	void (*scan)(const uint32_t *, size_t, int, uint64_t **);
+	int i;
+
+	scanner = malloc(sizeof(struct scanner));
+	if (scanner == NULL)
+		FATAL_ERROR("malloc");
+	memset(scanner, 0, sizeof(struct scanner));
+
+	scanner->program = program;
+	for (i = 0; i < SCANNER_CLASSES; i++)
+		scanner->classes[i] = bitmap_init(program);
+	scanner->skippable = bitmap_init(program);
+
+	scanner->implementation = "scalar";
+	scan = scanner_scan_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		scanner->implementation = "avx2";
+		scan = scanner_scan_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		scanner->implementation = "sse2";
+		scan = scanner_scan_sse2;
+	}
+#endif
+
+	LIST_ITERATOR(program->sections, i)
+		if (program->sections[i].executable)
+			scanner_scan_section(scanner, i, scan);
+
+	return scanner;
+}
+
+void scanner_free(struct scanner *scanner)
+{
+	int i;
+
+	for (i = 0; i < SCANNER_CLASSES; i++)
+		bitmap_free(scanner->classes[i]);
+	bitmap_free(scanner->skippable);
+
+	free(scanner);
+}
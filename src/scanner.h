@@ -0,0 +1,60 @@
+/**
+ * @file    scanner.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a scanner that classifies all words of the executable
+ * sections of a program at once, without decoding them one by one: each class
+ * of instructions is a bitmap (cf. bitmaps.h). Words are compared to
+ * patterns (mask and value) several at a time, with SSE2 or AVX2 instructions
+ * when the processor has them.
+ * Words that are not branches, loads at immediate offset from PC nor system
+ * calls are marked as skippable: the decompiler does not need to decode them.
+ */
+
+#if !defined(SCANNER_H)
+#define SCANNER_H
+
+#include <stdint.h>
+
+#include "bitmaps.h"
+#include "common.h"
+#include "vm.h"
+
+enum {
+	SCANNER_BRANCH, // anything that affects PC, including BLX(1)
+	SCANNER_LINK, // BL, BLX
+	SCANNER_SYSCALL,
+	SCANNER_LOAD_STATIC, // load at immediate offset from PC
+	SCANNER_MOV_LR_PC,
+	SCANNER_PROLOGUE, // push of LR
+	SCANNER_CLASSES
+};
+
+struct scanner {
+	struct vm_program *program;
+	const char *implementation; // "avx2", "sse2" or "scalar"
+	struct bitmap *classes[SCANNER_CLASSES];
+	struct bitmap *skippable;
+};
+
+struct scanner *scanner_init(struct vm_program *program);
+void scanner_free(struct scanner *scanner);
+
+#endif
@@ -0,0 +1,614 @@
+/**
+ * @file    server.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a server answering queries (cf. query.h) about programs over
+ * a Unix domain socket, and the client side to ask it. The server keeps the
+ * programs it analysed in memory, by hash of their content, and frees the least
+ * recently used ones above a memory limit: queries on the same program do not
+ * need to load and decompile it again. Programs are decompiled in a child
+ * process, so that one the analyser can not handle does not stop the server.
+ *
+ * Every message is a 32-bit length, in network byte order, followed by that
+ * many bytes. A request is the path of a program, a newline, then a query. The
+ * server answers with a 32-bit status (0 on success, 1 if the query failed),
+ * then a message: the result of the query, or what went wrong. A connection
+ * can carry any number of requests. The server waits for all connections at
+ * once, and answers requests one after the other: a long analysis delays the
+ * other clients, but an idle client does not.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "decompiler.h"
+#include "query.h"
+#include "server.h"
+#include "vm.h"
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void server_stop(int signal)
+{
+	server_stopping = 1;
+}
+
+/**
+ * Writes or reads exactly size bytes. Returns 0 on success.
+ */
+static int server_write(int fd, const void *data, size_t size)
+{
+	const char *bytes = data;
+	ssize_t done;
+
+	while (size > 0) {
+		done = write(fd, bytes, size);
+		if (done < 0 && errno == EINTR && !server_stopping)
+			continue;
+		if (done <= 0)
+			return -1;
+		bytes += done;
+		size -= done;
+	}
+
+	return 0;
+}
+
+static int server_read(int fd, void *data, size_t size)
+{
+	char *bytes = data;
+	ssize_t done;
+
+	while (size > 0) {
+		done = read(fd, bytes, size);
+		if (done < 0 && errno == EINTR && !server_stopping)
+			continue;
+		if (done <= 0)
+			return -1;
+		bytes += done;
+		size -= done;
+	}
+
+	return 0;
+}
+
+/**
+ * Sends a message: its length, then its data.
+ */
+static int server_send(int fd, const char *data, uint32_t length)
+{
+	uint32_t header = htonl(length);
+
+	if (server_write(fd, &header, sizeof(header)) != 0)
+		return -1;
+	return server_write(fd, data, length);
+}
+
+/**
+ * Receives a message of at most max_length bytes. It is allocated, and ends
+ * with '\0'. Returns 0 on success.
+ */
+static int server_receive(int fd, uint32_t max_length, char **data)
+{
+	uint32_t length;
+
+	if (server_read(fd, &length, sizeof(length)) != 0)
+		return -1;
+	length = ntohl(length);
+	if (length > max_length)
+		return -1;
+
+	*data = malloc(length + 1);
+	if (*data == NULL)
+		FATAL_ERROR("malloc");
+	if (server_read(fd, *data, length) != 0) {
+		free(*data);
+		return -1;
+	}
+	(*data)[length] = '\0';
+
+	return 0;
+}
+
+/**
+ * Checks that a file is a 32-bit ARM executable, to answer a clear error about
+ * other files instead of trying to analyse them.
+ */
+static int server_is_program(const char *filename)
+{
+	unsigned char header[20];
+	int fd, msb, type, machine;
+
+	fd = open(filename, O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+	if (read(fd, header, sizeof(header)) != sizeof(header)) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+
+	if (memcmp(header, ELFMAG, SELFMAG) != 0
+		|| header[EI_CLASS] != ELFCLASS32)
+		return 0;
+	msb = header[EI_DATA] == ELFDATA2MSB;
+	type = msb ? header[16] << 8 | header[17] : header[17] << 8 | header[16];
+	machine = msb ? header[18] << 8 | header[19] : header[19] << 8 | header[18];
+
+	return type == ET_EXEC && machine == EM_ARM;
+}
+
+static void server_free_entry(struct server *server, int i)
+{
+	struct server_entry *entry = server->entries[i];
+	int j;
+
+	LIST_ITERATOR_REVERSE(server->files, j)
+		if (server->files[j].entry == entry)
+			LIST_REMOVE(server->files, j);
+
+	database_close(entry->database);
+	// Keep one rebuilt_program, and its memory, for the next program loaded
+	if (server->spare == NULL) {
+		rp_reset(entry->rp);
+		server->spare = entry->rp;
+	} else {
+		rp_free(entry->rp);
+	}
+	server->memory -= entry->memory;
+	free(entry);
+
+	LIST_REMOVE(server->entries, i);
+}
+
+/**
+ * Frees the least recently used programs until the memory limit is met. The
+ * given entry, being used, is kept even if it exceeds the limit alone.
+ */
+static void server_evict(struct server *server, struct server_entry *keep)
+{
+	int i, lru;
+
+	while (server->memory > server->memory_limit
+		&& LIST_LENGTH(server->entries) > 1) {
+		lru = -1;
+		LIST_ITERATOR(server->entries, i)
+			if (server->entries[i] != keep && (lru == -1
+				|| server->entries[i]->last_use
+				< server->entries[lru]->last_use))
+				lru = i;
+		server_free_entry(server, lru);
+	}
+}
+
+/**
+ * Decompiles a program in a child process, which writes the result in a
+ * temporary database: errors in the analysis (cf. FATAL_ERROR) only stop the
+ * child. The rebuilt program must be empty: the child fills its own copy, then
+ * the database is loaded in it. Returns the database, or NULL with a message in
+ * error (QUERY_ERROR_SIZE bytes).
+ */
+static struct database *server_analyse(struct server *server,
+	const char *filename, struct rebuilt_program *rp, char *error)
+{
+	struct vm_program *program;
+	struct database *database;
+	char temporary[] = "/tmp/arm-analyser-XXXXXX";
+	pid_t child;
+	int fd, status;
+
+	fd = mkstemp(temporary);
+	if (fd < 0) {
+		snprintf(error, QUERY_ERROR_SIZE, "can not create a temporary file");
+		return NULL;
+	}
+	close(fd);
+
+	fflush(NULL);
+	child = fork();
+	if (child < 0) {
+		unlink(temporary);
+		snprintf(error, QUERY_ERROR_SIZE, "can not fork");
+		return NULL;
+	} else if (child == 0) {
+		program = vm_open_program(filename);
+		decompile(program, rp, server->mode, server->jobs);
+		database_write(temporary, program, rp, server->mode);
+		exit(0);
+	}
+
+	while (waitpid(child, &status, 0) < 0)
+		if (errno != EINTR)
+			FATAL_ERROR("waitpid");
+	database = NULL;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		database = database_open(temporary, filename, server->mode, rp);
+	// The database stays mapped
+	unlink(temporary);
+	if (database == NULL)
+		snprintf(error, QUERY_ERROR_SIZE, "can not analyse %s", filename);
+
+	return database;
+}
+
+/**
+ * Remembers that a file, described by st, contains the program of an entry.
+ */
+static void server_add_file(struct server *server, const struct stat *st,
+	struct server_entry *entry)
+{
+	struct server_file file;
+
+	file.device = st->st_dev;
+	file.inode = st->st_ino;
+	file.size = st->st_size;
+	file.modification = st->st_mtim;
+	file.entry = entry;
+	LIST_APPEND(server->files, file);
+}
+
+/**
+ * Returns the analysed program with the same content as a file. If there is
+ * none, the file is analysed (or its database loaded, if it is up to date).
+ * A file is only read (to hash its content) if it is new, or was modified.
+ * Returns NULL on error, with a message in error (QUERY_ERROR_SIZE bytes).
+ */
+static struct server_entry *server_get_entry(struct server *server,
+	const char *filename, char *error)
+{
+	struct server_entry *entry;
+	struct server_file *file;
+	struct database *database;
+	struct rebuilt_program *rp;
+	uint64_t program_hash, program_size;
+	struct stat st;
+	char *database_file;
+	int i;
+
+	if (stat(filename, &st) != 0) {
+		snprintf(error, QUERY_ERROR_SIZE, "can not read %s", filename);
+		return NULL;
+	}
+	LIST_ITERATOR(server->files, i) {
+		file = &(server->files[i]);
+		if (file->device != st.st_dev || file->inode != st.st_ino)
+			continue;
+		if (file->size == st.st_size
+			&& file->modification.tv_sec == st.st_mtim.tv_sec
+			&& file->modification.tv_nsec == st.st_mtim.tv_nsec) {
+			file->entry->last_use = ++server->uses;
+			return file->entry;
+		}
+		LIST_REMOVE(server->files, i); // modified since
+		break;
+	}
+
+	// Hashed after stat(): if the file changes meanwhile, it is hashed again
+	if (database_hash_file(filename, &program_hash, &program_size) != 0) {
+		snprintf(error, QUERY_ERROR_SIZE, "can not read %s", filename);
+		return NULL;
+	}
+	LIST_ITERATOR(server->entries, i) {
+		entry = server->entries[i];
+		if (entry->program_hash == program_hash
+			&& entry->program_size == program_size) {
+			entry->last_use = ++server->uses;
+			server_add_file(server, &st, entry);
+			return entry;
+		}
+	}
+
+	if (!server_is_program(filename)) {
+		snprintf(error, QUERY_ERROR_SIZE, "%s is not a 32-bit ARM executable",
+			filename);
+		return NULL;
+	}
+
+	database_file = malloc(strlen(filename) + sizeof(DATABASE_SUFFIX));
+	if (database_file == NULL)
+		FATAL_ERROR("malloc");
+	sprintf(database_file, "%s%s", filename, DATABASE_SUFFIX);
+	rp = server->spare != NULL ? server->spare : rp_new();
+	server->spare = NULL;
+	database = database_open(database_file, filename, server->mode, rp);
+	free(database_file);
+	if (database == NULL
+		&& (database = server_analyse(server, filename, rp, error)) == NULL) {
+		server->spare = rp; // still empty
+		return NULL;
+	}
+
+	entry = malloc(sizeof(struct server_entry));
+	if (entry == NULL)
+		FATAL_ERROR("malloc");
+	memset(entry, 0, sizeof(struct server_entry));
+	entry->program_hash = program_hash;
+	entry->program_size = program_size;
+	entry->database = database;
+	entry->rp = rp;
+	entry->memory = database->size + arena_size(entry->rp->arena);
+	entry->last_use = ++server->uses;
+
+	LIST_APPEND(server->entries, entry);
+	server_add_file(server, &st, entry);
+	server->memory += entry->memory;
+	server_evict(server, entry);
+
+	return entry;
+}
+
+/**
+ * Answers one request of a client. Returns -1 if the connection is over.
+ */
+static int server_handle_request(struct server *server, int fd)
+{
+	struct server_entry *entry;
+	struct query query;
+	char *request, *query_text, *result, error[QUERY_ERROR_SIZE];
+	size_t result_size;
+	uint32_t status;
+	FILE *out;
+	int sent;
+
+	if (server_receive(fd, SERVER_MAX_REQUEST, &request) != 0)
+		return -1;
+	error[0] = '\0';
+	result = NULL;
+	result_size = 0;
+
+	memset(&query, 0, sizeof(query));
+	query.hide_stdlib = STDLIB_HIDE;
+	query_text = strchr(request, '\n');
+	if (query_text == NULL) {
+		snprintf(error, QUERY_ERROR_SIZE, "bad request");
+	} else {
+		*(query_text++) = '\0';
+		if (query_parse(&query, query_text, error) == 1)
+			snprintf(error, QUERY_ERROR_SIZE, "empty query");
+		else if (error[0] == '\0' && query.output != NULL)
+			snprintf(error, QUERY_ERROR_SIZE, "output files are not "
+				"allowed");
+	}
+
+	if (error[0] == '\0'
+		&& (entry = server_get_entry(server, request, error)) != NULL) {
+		out = open_memstream(&result, &result_size);
+		if (out == NULL)
+			FATAL_ERROR("open_memstream");
+		query_run(NULL, entry->rp, out, &query, error);
+		fclose(out);
+	}
+
+	status = htonl(error[0] != '\0');
+	if (server_write(fd, &status, sizeof(status)) == 0)
+		sent = error[0] != '\0' ? server_send(fd, error, strlen(error))
+			: server_send(fd, result, result_size);
+	else
+		sent = -1;
+	free(result);
+	free(request);
+
+	return sent;
+}
+
+/**
+ * Waits until the listening socket or a client is ready, or until the first
+ * client reaches the idle timeout. Fills fds: the listening socket, then the
+ * clients in order. Returns the number of ready sockets.
+ */
+static int server_poll(struct server *server, int fd, struct pollfd *fds)
+{
+	time_t now = time(NULL), deadline = 0;
+	int i, timeout = -1;
+
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+	LIST_ITERATOR(server->clients, i) {
+		fds[i + 1].fd = server->clients[i].fd;
+		fds[i + 1].events = POLLIN;
+		if (i == 0 || server->clients[i].last_request < deadline)
+			deadline = server->clients[i].last_request;
+	}
+	if (LIST_LENGTH(server->clients) > 0) {
+		deadline += SERVER_TIMEOUT;
+		timeout = deadline > now ? (deadline - now) * 1000 : 0;
+	}
+
+	return poll(fds, LIST_LENGTH(server->clients) + 1, timeout);
+}
+
+/**
+ * Listens on a Unix domain socket, and answers queries until SIGINT or SIGTERM.
+ * The memory limit is in bytes. Returns 0 on success.
+ */
+int server_run(const char *socket_path, int mode, int jobs,
+	size_t memory_limit)
+{
+	struct server server;
+	struct sockaddr_un address;
+	struct sigaction action;
+	struct timeval timeout;
+	struct pollfd *fds;
+	struct server_client client;
+	struct stat st;
+	time_t now;
+	int fd, i;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s.\n", socket_path);
+		return 1;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	// Replace the socket of a previous server, but nothing else
+	if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socket_path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		FATAL_ERROR("socket");
+	if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0
+		|| listen(fd, SERVER_BACKLOG) != 0) {
+		fprintf(stderr, "Can not listen on %s: %s.\n", socket_path,
+			strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	// Signals interrupt accept() and read(), to stop the server at once
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = server_stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&server, 0, sizeof(server));
+	server.mode = mode;
+	server.jobs = jobs;
+	server.memory_limit = memory_limit;
+	LIST_INIT(server.entries);
+	LIST_INIT(server.files);
+	LIST_INIT(server.clients);
+	LIST_INIT(fds);
+
+	// Once a request starts, a client can not stall the others for longer
+	timeout.tv_sec = SERVER_TIMEOUT;
+	timeout.tv_usec = 0;
+	while (!server_stopping) {
+		LIST_RESERVE(fds, LIST_LENGTH(server.clients) + 1);
+		if (server_poll(&server, fd, fds) < 0) {
+			if (errno == EINTR)
+				continue;
+			FATAL_ERROR("poll");
+		}
+
+		// Clients go away when they are done, or idle for too long
+		now = time(NULL);
+		LIST_ITERATOR_REVERSE(server.clients, i) {
+			if (fds[i + 1].revents != 0) {
+				if (server_handle_request(&server, fds[i + 1].fd) == 0) {
+					server.clients[i].last_request = time(NULL);
+					continue;
+				}
+			} else if (now - server.clients[i].last_request < SERVER_TIMEOUT) {
+				continue;
+			}
+			close(server.clients[i].fd);
+			LIST_REMOVE(server.clients, i);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			client.fd = accept(fd, NULL, NULL);
+			if (client.fd < 0) {
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				FATAL_ERROR("accept");
+			}
+			setsockopt(client.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+				sizeof(timeout));
+			setsockopt(client.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+				sizeof(timeout));
+			client.last_request = time(NULL);
+			LIST_APPEND(server.clients, client);
+		}
+	}
+
+	close(fd);
+	unlink(socket_path);
+	LIST_ITERATOR(server.clients, i)
+		close(server.clients[i].fd);
+	LIST_FREE(server.clients);
+	LIST_FREE(fds);
+	while (LIST_LENGTH(server.entries) > 0)
+		server_free_entry(&server, 0);
+	LIST_FREE(server.entries);
+	LIST_FREE(server.files);
+	if (server.spare != NULL)
+		rp_free(server.spare);
+
+	return 0;
+}
+
+/**
+ * Connects to a server. Returns the socket, or -1.
+ */
+int server_connect(const char *socket_path)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Sends a query about a program (an absolute path, as the server may run in
+ * another directory) to a server, and receives the answer, allocated and
+ * ending with '\0'. Returns 0 if the query succeeded, 1 if it failed (then the
+ * answer is what went wrong), or -1 if the connection failed.
+ */
+int server_ask(int fd, const char *program, const char *query,
+	char **response)
+{
+	uint32_t status;
+	char *request;
+	int ret;
+
+	request = malloc(strlen(program) + strlen(query) + 2);
+	if (request == NULL)
+		FATAL_ERROR("malloc");
+	sprintf(request, "%s\n%s", program, query);
+	ret = server_send(fd, request, strlen(request));
+	free(request);
+
+	if (ret != 0 || server_read(fd, &status, sizeof(status)) != 0
+		|| server_receive(fd, UINT32_MAX - 1, response) != 0)
+		return -1;
+
+	return ntohl(status) != 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file    server.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a server answering queries (cf. query.h) about programs over
+ * a Unix domain socket, and the client side to ask it. The server keeps the
+ * programs it analysed in memory, by hash of their content, and frees the least
+ * recently used ones above a memory limit: queries on the same program do not
+ * need to load and decompile it again. Programs are decompiled in a child
+ * process, so that one the analyser can not handle does not stop the server.
+ *
+ * Every message is a 32-bit length, in network byte order, followed by that
+ * many bytes. A request is the path of a program, a newline, then a query. The
+ * server answers with a 32-bit status (0 on success, 1 if the query failed),
+ * then a message: the result of the query, or what went wrong. A connection
+ * can carry any number of requests. The server waits for all connections at
+ * once, and answers requests one after the other: a long analysis delays the
+ * other clients, but an idle client does not.
+ */
+
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "common.h"
+#include "database.h"
+#include "rebuilt_program.h"
+
+#define SERVER_MAX_REQUEST	4096
+#define SERVER_BACKLOG	16
+// A connection that stays idle longer than this (in seconds) is closed
+#define SERVER_TIMEOUT	30
+// Default memory limit for analysed programs, in MiB
+#define SERVER_DEFAULT_MEMORY	256
+
+/**
+ * A program analysed by the server.
+ */
+struct server_entry {
+	uint64_t program_hash;
+	uint64_t program_size;
+	struct database *database; // cf. server_analyse()
+	struct rebuilt_program *rp;
+	size_t memory; // approximate size in memory
+	unsigned long last_use;
+};
+
+/**
+ * A file known to contain the program of an entry. As long as it is not
+ * modified, it is not read again.
+ */
+struct server_file {
+	dev_t device;
+	ino_t inode;
+	off_t size;
+	struct timespec modification;
+	struct server_entry *entry;
+};
+
+struct server_client {
+	int fd;
+	time_t last_request;
+};
+
+struct server {
+	int mode;
+	int jobs;
+	size_t memory_limit;
+	size_t memory; // used by all entries
+	struct server_entry **entries;
+	struct server_file *files;
+	struct server_client *clients;
+	struct rebuilt_program *spare; // emptied by rp_reset(), or NULL
+	unsigned long uses; // clock for last_use
+};
+
+int server_run(const char *socket_path, int mode, int jobs,
+	size_t memory_limit);
+
+int server_connect(const char *socket_path);
+int server_ask(int fd, const char *program, const char *query,
+	char **response);
+
+#endif
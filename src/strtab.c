@@ -0,0 +1,177 @@
+/**
+ * @file    strtab.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a table of strings, where each string is stored only once.
+ * Strings are identified by their offset in the table, which is a 32-bit
+ * integer: structures that need a name (symbols, functions...) only hold this
+ * offset. Offset 0 is always the empty string.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "strtab.h"
+
+/**
+ * Hash function for strings (FNV-1a).
+ */
+uint32_t strtab_hash(const char *string)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*string != '\0') {
+		hash ^= (uint8_t) *string++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+struct strtab *strtab_init()
+{
+	struct strtab *strtab;
+
+	strtab = malloc(sizeof(struct strtab));
+	if (strtab == NULL)
+		FATAL_ERROR("malloc");
+	memset(strtab, 0, sizeof(struct strtab));
+
+	strtab->capacity = 4096;
+	strtab->data = malloc(strtab->capacity);
+	if (strtab->data == NULL)
+		FATAL_ERROR("malloc");
+	// The empty string, at offset 0
+	strtab->data[0] = '\0';
+	strtab->length = 1;
+
+	strtab->hash_size = 256;
+	strtab->hash = calloc(strtab->hash_size, sizeof(uint32_t));
+	if (strtab->hash == NULL)
+		FATAL_ERROR("calloc");
+
+	return strtab;
+}
+
+void strtab_free(struct strtab *strtab)
+{
+	free(strtab->data);
+	free(strtab->hash);
+
+	free(strtab);
+}
+
+/**
+ * Finds the slot of the hash table where a string is, or where it should be
+ * inserted.
+ */
+static uint32_t strtab_slot(struct strtab *strtab, const char *string,
+	uint32_t hash)
+{
+	uint32_t mask = strtab->hash_size - 1;
+	uint32_t slot;
+
+	for (slot = hash & mask; strtab->hash[slot] != 0; slot = (slot + 1) & mask)
+		if (strcmp(strtab->data + strtab->hash[slot], string) == 0)
+			break;
+
+	return slot;
+}
+
+/**
+ * Doubles the size of the hash table, and re-inserts all strings.
+ */
+static void strtab_grow_hash(struct strtab *strtab)
+{
+	uint32_t *old_hash = strtab->hash;
+	uint32_t old_size = strtab->hash_size;
+	uint32_t i, offset;
+
+	strtab->hash_size *= 2;
+	strtab->hash = calloc(strtab->hash_size, sizeof(uint32_t));
+	if (strtab->hash == NULL)
+		FATAL_ERROR("calloc");
+
+	for (i = 0; i < old_size; i++) {
+		offset = old_hash[i];
+		if (offset != 0)
+			strtab->hash[strtab_slot(strtab, strtab->data + offset,
+				strtab_hash(strtab->data + offset))] = offset;
+	}
+
+	free(old_hash);
+}
+
+/**
+ * Adds a string to the table, if it is not there yet, and returns its offset.
+ */
+uint32_t strtab_add(struct strtab *strtab, const char *string)
+{
+	uint32_t slot, size, offset;
+
+	if (string[0] == '\0')
+		return 0;
+
+	slot = strtab_slot(strtab, string, strtab_hash(string));
+	if (strtab->hash[slot] != 0)
+		return strtab->hash[slot];
+
+	size = strlen(string) + 1;
+	while (strtab->length + size > strtab->capacity) {
+		strtab->capacity *= 2;
+		strtab->data = realloc(strtab->data, strtab->capacity);
+		if (strtab->data == NULL)
+			FATAL_ERROR("realloc");
+	}
+	offset = strtab->length;
+	memcpy(strtab->data + offset, string, size);
+	strtab->hash[slot] = offset;
+	strtab->length += size;
+	strtab->count++;
+
+	// Keep the hash table at most half full
+	if (2 * strtab->count > strtab->hash_size)
+		strtab_grow_hash(strtab);
+
+	return offset;
+}
+
+/**
+ * Finds a string in the table, without adding it. Returns 0 and sets offset
+ * if the string was found, 1 otherwise.
+ */
+int strtab_find(struct strtab *strtab, const char *string, uint32_t *offset)
+{
+	uint32_t slot;
+
+	if (string[0] == '\0') {
+		*offset = 0;
+		return 0;
+	}
+
+	slot = strtab_slot(strtab, string, strtab_hash(string));
+	if (strtab->hash[slot] == 0)
+		return 1;
+
+	*offset = strtab->hash[slot];
+	return 0;
+}
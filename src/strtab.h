@@ -0,0 +1,55 @@
+/**
+ * @file    strtab.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a table of strings, where each string is stored only once.
+ * Strings are identified by their offset in the table, which is a 32-bit
+ * integer: structures that need a name (symbols, functions...) only hold this
+ * offset. Offset 0 is always the empty string.
+ */
+
+#if !defined(STRTAB_H)
+#define STRTAB_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+struct strtab {
+	char *data;
+	uint32_t length;
+	uint32_t capacity;
+	uint32_t *hash; // open-addressing table of offsets, 0 for empty slots
+	uint32_t hash_size;
+	uint32_t count;
+};
+
+uint32_t strtab_hash(const char *string);
+
+struct strtab *strtab_init();
+void strtab_free(struct strtab *strtab);
+
+uint32_t strtab_add(struct strtab *strtab, const char *string);
+int strtab_find(struct strtab *strtab, const char *string, uint32_t *offset);
+
+#define strtab_get(_strtab, _offset)	\
+	((const char *) (_strtab)->data + (_offset))
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file    sweep.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a way to read all executable sections of a program linearly
+ * ("linear sweep"), instead of following branches from the entry point. The
+ * sections are split into chunks of about the same size, and each chunk is
+ * given to a function by one of several threads (cf. workers.h). Results are
+ * meant to be stored per chunk, so that they can be merged in address order
+ * whatever the number of threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "sweep.h"
+#include "workers.h"
+
+// Chunks are made of whole 64-word blocks (cf. bitmaps.h), with at least
+// this number of words
+#define SWEEP_CHUNK_MIN_WORDS	4096
+// Each thread gets this number of chunks on average, to balance the work
+#define SWEEP_CHUNKS_PER_JOB	4
+
+struct sweep *sweep_init(struct vm_program *program, int jobs)
+{
+	struct sweep *sweep;
+	struct sweep_chunk chunk;
+	size_t words = 0, chunk_words;
+	vmptr_t end;
+	int i;
+
+	sweep = malloc(sizeof(struct sweep));
+	if (sweep == NULL)
+		FATAL_ERROR("malloc");
+	memset(sweep, 0, sizeof(struct sweep));
+
+	sweep->program = program;
+	sweep->jobs = jobs;
+
+	LIST_ITERATOR(program->sections, i)
+		if (program->sections[i].executable)
+			words += program->sections[i].size / 4;
+	chunk_words = words / (jobs * SWEEP_CHUNKS_PER_JOB);
+	chunk_words = (chunk_words + 63) & ~(size_t) 63;
+	if (chunk_words < SWEEP_CHUNK_MIN_WORDS)
+		chunk_words = SWEEP_CHUNK_MIN_WORDS;
+
+	// A chunk never spans two sections
+	LIST_INIT(sweep->chunks);
+	LIST_ITERATOR(program->sections, i) {
+		if (!program->sections[i].executable)
+			continue;
+		end = program->sections[i].vaddr + program->sections[i].size / 4 * 4;
+		for (chunk.start = program->sections[i].vaddr; chunk.start < end;
+			chunk.start = chunk.end) {
+			chunk.end = chunk.start + chunk_words * 4;
+			if (chunk.end > end || chunk.end < chunk.start)
+				chunk.end = end;
+			LIST_APPEND(sweep->chunks, chunk);
+		}
+	}
+
+	return sweep;
+}
+
+void sweep_free(struct sweep *sweep)
+{
+	LIST_FREE(sweep->chunks);
+
+	free(sweep);
+}
+
+static void sweep_process_chunks(void *data, int first, int last)
+{
+	struct sweep *sweep = data;
+	int i;
+
+	for (i = first; i < last; i++)
+		sweep->process(sweep->data, i, sweep->chunks[i].start,
+			sweep->chunks[i].end);
+}
+
+/**
+ * Calls process() on each chunk, with all threads, and waits until they are
+ * done. Chunks are processed in any order, several at the same time.
+ */
+void sweep_run(struct sweep *sweep,
+	void (*process)(void *data, int chunk, vmptr_t start, vmptr_t end),
+	void *data)
+{
+	sweep->process = process;
+	sweep->data = data;
+
+	workers_run(sweep->jobs, LIST_LENGTH(sweep->chunks), 1,
+		sweep_process_chunks, sweep);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file    sweep.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a way to read all executable sections of a program linearly
+ * ("linear sweep"), instead of following branches from the entry point. The
+ * sections are split into chunks of about the same size, and each chunk is
+ * given to a function by one of several threads (cf. workers.h). Results are
+ * meant to be stored per chunk, so that they can be merged in address order
+ * whatever the number of threads.
+ */
+
+#if !defined(SWEEP_H)
+#define SWEEP_H
+
+#include "common.h"
+#include "vm.h"
+
+/**
+ * A chunk is in one section, and starts at a multiple of 64 words from the
+ * start of the section: it is made of whole blocks of bitmaps (cf. bitmaps.h).
+ */
+struct sweep_chunk {
+	vmptr_t start;
+	vmptr_t end;
+};
+
+struct sweep {
+	struct vm_program *program;
+	int jobs;
+	struct sweep_chunk *chunks; // sorted by address
+	void (*process)(void *data, int chunk, vmptr_t start, vmptr_t end);
+	void *data;
+};
+
+struct sweep *sweep_init(struct vm_program *program, int jobs);
+void sweep_free(struct sweep *sweep);
+
+void sweep_run(struct sweep *sweep,
+	void (*process)(void *data, int chunk, vmptr_t start, vmptr_t end),
+	void *data);
+
+#endif
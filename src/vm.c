@@ -24,6 +24,7 @@
  * virtual address space of the program.
  */
 
+#include "arrays.h"
 #include "common.h"
 #include "vm.h"
 
@@ -33,9 +34,10 @@ static int vm_load_sections_elf32bitarm(struct vm_program *program);
 static int vm_load_section(struct vm_program *program, GElf_Shdr *shdr,
 	Elf_Scn *scn);
 static int vm_free_sections(struct vm_program *program);
+static void vm_index_sections(struct vm_program *program);
 
-static void vm_set_symbol_name(struct vm_program *program, vmptr_t addr,
-	const char *name);
+static void vm_build_symbols(struct vm_program *program,
+	struct vm_raw_symbol *raw_symbols);
 
 /**
  * Opens a binary file and creates a new vm_program corresponding to it.
@@ -43,6 +45,7 @@ static void vm_set_symbol_name(struct vm_program *program, vmptr_t addr,
 struct vm_program *vm_open_program(const char *filename)
 {
 	struct vm_program *program;
+	struct stat st;
 
 	// Initialize data structure
 	program = malloc(sizeof(struct vm_program));
@@ -53,6 +56,7 @@ struct vm_program *vm_open_program(const char *filename)
 	LIST_INIT(program->sections);
 
 	LIST_INIT(program->symbols);
+	program->strings = strtab_init();
 
 	// Open file and make checks
 	if (elf_version(EV_CURRENT) == EV_NONE)
@@ -62,7 +66,16 @@ struct vm_program *vm_open_program(const char *filename)
 	if (program->fd < 0)
 		FATAL_ERROR("open");
 
-	program->elf = elf_begin(program->fd, ELF_C_READ, NULL);
+	// Map the whole file once: sections will point directly into it
+	if (fstat(program->fd, &st) != 0)
+		FATAL_ERROR("fstat");
+	program->file_size = st.st_size;
+	program->file_map = mmap(NULL, program->file_size, PROT_READ, MAP_PRIVATE,
+		program->fd, 0);
+	if (program->file_map == MAP_FAILED)
+		FATAL_ERROR("mmap");
+
+	program->elf = elf_begin(program->fd, ELF_C_READ_MMAP, NULL);
 	if (program->elf == NULL)
 		FATAL_ERROR("elf_begin");
 
@@ -71,6 +84,7 @@ struct vm_program *vm_open_program(const char *filename)
 
 	// Load exetutable sections into memory
 	vm_load_sections_elf32bitarm(program);
+	vm_index_sections(program);
 
 	elf_end(program->elf);
 
@@ -85,9 +99,14 @@ struct vm_program *vm_open_program(const char *filename)
 void vm_close_program(struct vm_program *program)
 {
 	LIST_FREE(program->symbols);
+	free(program->symbols_hash);
+	strtab_free(program->strings);
 
 	vm_free_sections(program);
 	LIST_FREE(program->sections);
+	free(program->pages);
+
+	munmap(program->file_map, program->file_size);
 
 	free(program);
 }
@@ -130,9 +149,12 @@ static int vm_load_sections_elf32bitarm(struct vm_program *program)
 	Elf_Data *edata;
 	GElf_Sym sym;
 	int symbols_num, i;
+	struct vm_raw_symbol raw_symbol;
+	struct vm_raw_symbol *raw_symbols;
+
+	LIST_INIT(raw_symbols);
 
 	// Read ELF, section by section
-	program->elf = elf_begin(program->fd, ELF_C_READ, NULL);
 	scn = NULL;
 	while ((scn = elf_nextscn(program->elf, scn)) != NULL) {
 		gelf_getshdr(scn, &shdr);
@@ -148,25 +170,36 @@ static int vm_load_sections_elf32bitarm(struct vm_program *program)
 		if (shdr.sh_type == SHT_SYMTAB) {
 			edata = elf_getdata(scn, NULL);
 			symbols_num = shdr.sh_size / shdr.sh_entsize;
+			LIST_RESERVE(raw_symbols, LIST_LENGTH(raw_symbols) + symbols_num);
 			for (i = 0; i < symbols_num; i++) {
 				if (gelf_getsym(edata, i, &sym) == 0)
 					FATAL_ERROR("gelf_getsym");
-				if (sym.st_name != 0)
-					vm_set_symbol_name(program, sym.st_value,
-						elf_strptr(program->elf, shdr.sh_link, sym.st_name));
+				if (sym.st_name != 0) {
+					raw_symbol.addr = sym.st_value;
+					raw_symbol.name = elf_strptr(program->elf, shdr.sh_link,
+						sym.st_name);
+					raw_symbol.order = LIST_LENGTH(raw_symbols);
+					LIST_APPEND(raw_symbols, raw_symbol);
+				}
 					//printf("%08x\t%d\t%s\n", (unsigned int) sym.st_value, (int) sym.st_size, elf_strptr(program->elf, shdr.sh_link, sym.st_name));
 			}
 		}
 	}
 
+	// Names are still in the ELF data, index them before it is released
+	vm_build_symbols(program, raw_symbols);
+	LIST_FREE(raw_symbols);
+
 	//vm_dump_symbols(program);
 
 	return 0;
 }
 
 /**
- * Loads a given section from the source program by allocating memory and
- * copying data.
+ * Loads a given section from the source program.
+ * When libelf gives the section's bytes untranslated, in one piece, the
+ * section simply points into the file mapping. Else, memory is allocated and
+ * data is copied.
  */
 static int vm_load_section(struct vm_program *program, GElf_Shdr *shdr,
 	Elf_Scn *scn)
@@ -175,13 +208,27 @@ static int vm_load_section(struct vm_program *program, GElf_Shdr *shdr,
 	Elf_Data *edata;
 	vmptr_t offset;
 
-	// Add new element to sections list
 	section.offset = shdr->sh_offset;
 	section.vaddr = shdr->sh_addr;
 	section.size = shdr->sh_size;
+	section.executable = (shdr->sh_flags & SHF_EXECINSTR) != 0;
+
+	edata = elf_getdata(scn, NULL);
+	if (edata != NULL && edata->d_type == ELF_T_BYTE
+		&& edata->d_size == shdr->sh_size
+		&& elf_getdata(scn, edata) == NULL
+		&& shdr->sh_offset + shdr->sh_size <= program->file_size) {
+		section.map_addr = program->file_map + shdr->sh_offset;
+		section.is_copy = 0;
+		LIST_APPEND(program->sections, section);
+		return 0;
+	}
+
+	// Add new element to sections list
 	section.map_addr = malloc(shdr->sh_size);
 	if (section.map_addr == NULL)
 		FATAL_ERROR("malloc");
+	section.is_copy = 1;
 	LIST_APPEND(program->sections, section);
 
 	// Fill with data
@@ -197,13 +244,16 @@ static int vm_load_section(struct vm_program *program, GElf_Shdr *shdr,
 }
 
 /**
- * Frees sections allocated by vm_load_section.
+ * Frees sections copied by vm_load_section. Others belong to the file
+ * mapping.
  */
 static int vm_free_sections(struct vm_program *program)
 {
 	int i;
 
 	LIST_ITERATOR(program->sections, i) {
+		if (!program->sections[i].is_copy)
+			continue;
 		if (program->sections[i].map_addr == NULL)
 			printf("== ERROR: program->sections[%d].map_addr == NULL\n", i);
 		else
@@ -213,6 +263,112 @@ static int vm_free_sections(struct vm_program *program)
 	return 0;
 }
 
+/**
+ * Function to compare two sections by their virtual address.
+ * This is used by the sorting algorithm.
+ */
+static int cmp_sections_vaddr(const void *a, const void *b)
+{
+	vmptr_t A = ((struct vm_elf_section *) a)->vaddr,
+	        B = ((struct vm_elf_section *) b)->vaddr;
+	return A < B ? -1 : A > B;
+}
+
+/**
+ * Sorts the loaded sections by address, and builds the page table used to
+ * translate virtual addresses: for each page of the address space spanned by
+ * the sections, it gives the first section that may contain an address of
+ * this page.
+ */
+static void vm_index_sections(struct vm_program *program)
+{
+	struct vm_elf_section *section;
+	vmptr_t end, page_start;
+	size_t page;
+	int i, n;
+
+	n = LIST_LENGTH(program->sections);
+	if (n == 0)
+		return;
+	if (n >= VM_NO_SECTION)
+		FATAL_ERROR("too many sections");
+
+	merge_sort(program->sections, sizeof(*program->sections), n,
+		cmp_sections_vaddr);
+
+	end = 0;
+	LIST_ITERATOR(program->sections, i)
+		if (program->sections[i].vaddr + program->sections[i].size > end)
+			end = program->sections[i].vaddr + program->sections[i].size;
+
+	program->pages_base = program->sections[0].vaddr
+		& ~((1 << VM_PAGE_SHIFT) - 1);
+	program->pages_count = ((end - program->pages_base) >> VM_PAGE_SHIFT) + 1;
+	program->pages = malloc(program->pages_count * sizeof(uint16_t));
+	if (program->pages == NULL)
+		FATAL_ERROR("malloc");
+
+	i = 0;
+	for (page = 0; page < program->pages_count; page++) {
+		page_start = program->pages_base + (page << VM_PAGE_SHIFT);
+		// Skip sections that end before this page
+		while (i < n && program->sections[i].vaddr
+			+ program->sections[i].size <= page_start)
+			i++;
+		section = &(program->sections[i]);
+		if (i == n || section->vaddr >= page_start + (1 << VM_PAGE_SHIFT))
+			program->pages[page] = VM_NO_SECTION;
+		else
+			program->pages[page] = i;
+	}
+}
+
+/**
+ * Finds the section containing a given virtual address, and returns its index
+ * in the list of sections, or -1 if the address is not loaded.
+ */
+int vm_find_section(struct vm_program *program, vmptr_t vaddr)
+{
+	size_t page;
+	int i;
+
+	page = (vaddr - program->pages_base) >> VM_PAGE_SHIFT;
+	if (vaddr < program->pages_base || page >= program->pages_count)
+		return -1;
+
+	i = program->pages[page];
+	if (i == VM_NO_SECTION)
+		return -1;
+	// Several sections may share a page
+	while (vaddr >= program->sections[i].vaddr + program->sections[i].size)
+		if (++i == LIST_LENGTH(program->sections))
+			return -1;
+	if (vaddr < program->sections[i].vaddr)
+		return -1;
+
+	return i;
+}
+
+/**
+ * Gives direct access to the data at a given address in the studied program.
+ * Returns a pointer to it, and sets length to the number of bytes that can be
+ * read from there (until the end of the section), or returns NULL if the
+ * address is not loaded.
+ */
+void *vm_get_data(struct vm_program *program, vmptr_t vaddr, size_t *length)
+{
+	struct vm_elf_section *section;
+	int i;
+
+	i = vm_find_section(program, vaddr);
+	if (i < 0)
+		return NULL;
+
+	section = &(program->sections[i]);
+	*length = section->vaddr + section->size - vaddr;
+	return section->map_addr + vaddr - section->vaddr;
+}
+
 /**
  * Reads an instruction (or any other data) at a given address in the studied
  * program.
@@ -220,63 +376,108 @@ static int vm_free_sections(struct vm_program *program)
 uint32_t vm_read_instruction(struct vm_program *program, vmptr_t vaddr)
 {
 	int i;
-	void *addr;
 
-	LIST_ITERATOR(program->sections, i) {
-		if (vaddr >= program->sections[i].vaddr &&
-			vaddr < program->sections[i].vaddr + program->sections[i].size) {
-			//printf("in section %d (%p - %p)\n", length,
-			//	program->sections[length].vaddr,
-			//	program->sections[length].vaddr +
-			//	program->sections[length].size);
-			addr = program->sections[i].map_addr + vaddr
-				- program->sections[i].vaddr;
-			return *((uint32_t *) addr);
-		}
-	}
+	i = vm_find_section(program, vaddr);
+	if (i < 0)
+		FATAL_ERROR("read at invalid address 0x%08x", (int) vaddr);
 
-	FATAL_ERROR("read at invalid address 0x%08x", (int) vaddr);
-	return 0;
+	return *((uint32_t *) (program->sections[i].map_addr + vaddr
+		- program->sections[i].vaddr));
+}
+
+/**
+ * Function to compare two raw symbols by their address, then by their order
+ * of appearance.
+ * This is used by the sorting algorithm.
+ */
+static int cmp_raw_symbols(const void *a, const void *b)
+{
+	const struct vm_raw_symbol *A = a, *B = b;
+
+	if (A->addr != B->addr)
+		return A->addr < B->addr ? -1 : 1;
+	return A->order - B->order;
 }
 
 /**
  * Used to manage functions names.
- * Adds a new entry in the list of names, or replace the entry if there is
- * already one with the same address.
+ * Builds the list of symbols from all symbols found in the symbols table, in
+ * one pass: they are sorted by address, and when several symbols share an
+ * address, the last one gives its name. Names are stored in the program's
+ * strings table. Then, a hash table is built to find symbols by name. When
+ * several symbols have the same name, the one whose address appeared first in
+ * the symbols table is kept.
  */
-static void vm_set_symbol_name(struct vm_program *program, vmptr_t addr,
-	const char *name)
+static void vm_build_symbols(struct vm_program *program,
+	struct vm_raw_symbol *raw_symbols)
 {
-	int i;
 	struct vm_symbol new_symbol;
+	int *first_order;
+	int i, j, n;
+	uint32_t slot, mask;
+
+	n = LIST_LENGTH(raw_symbols);
+	merge_sort(raw_symbols, sizeof(*raw_symbols), n, cmp_raw_symbols);
+	LIST_RESERVE(program->symbols, n);
+
+	first_order = malloc((n + 1) * sizeof(int));
+	if (first_order == NULL)
+		FATAL_ERROR("malloc");
+
+	for (i = 0; i < n; i = j) {
+		// Symbols from i to j - 1 have the same address
+		for (j = i + 1; j < n && raw_symbols[j].addr == raw_symbols[i].addr;
+			j++) ;
+		new_symbol.addr = raw_symbols[i].addr;
+		new_symbol.name = strtab_add(program->strings, raw_symbols[j - 1].name);
+		first_order[LIST_LENGTH(program->symbols)] = raw_symbols[i].order;
+		LIST_APPEND(program->symbols, new_symbol);
+	}
 
-	// Count list elements
+	// The hash table is at least twice as big as the number of symbols
+	for (program->symbols_hash_size = 16;
+		program->symbols_hash_size < 2 * LIST_LENGTH(program->symbols);
+		program->symbols_hash_size *= 2) ;
+	program->symbols_hash = malloc(program->symbols_hash_size * sizeof(int));
+	if (program->symbols_hash == NULL)
+		FATAL_ERROR("malloc");
+	memset(program->symbols_hash, -1, program->symbols_hash_size * sizeof(int));
+
+	mask = program->symbols_hash_size - 1;
 	LIST_ITERATOR(program->symbols, i) {
-		// If entry already exist, just replace the name
-		if (program->symbols[i].addr == addr) {
-			strncpy(program->symbols[i].name, name, NAMES_LENGTH - 1);
-			return;
+		slot = strtab_hash(strtab_get(program->strings,
+			program->symbols[i].name)) & mask;
+		while ((j = program->symbols_hash[slot]) != -1) {
+			// Names are only stored once, so offsets can be compared
+			if (program->symbols[j].name == program->symbols[i].name)
+				break;
+			slot = (slot + 1) & mask;
 		}
+		if (j == -1 || first_order[i] < first_order[j])
+			program->symbols_hash[slot] = i;
 	}
 
-	// Entry does not exist yet, create a new one
-	new_symbol.addr = addr;
-	strncpy(new_symbol.name, name, NAMES_LENGTH - 1);
-	new_symbol.name[NAMES_LENGTH - 1] = 0;
-	LIST_APPEND(program->symbols, new_symbol);
+	free(first_order);
 }
 
 /**
  * Used to manage functions names.
  * Retrieves the symbol name associated with a given address, if it exists.
  */
-int vm_get_symbol_name(struct vm_program *program, vmptr_t addr, char *name)
+int vm_get_symbol_name(struct vm_program *program, vmptr_t addr,
+	uint32_t *name)
 {
-	int i;
-
-	LIST_ITERATOR(program->symbols, i) {
-		if (program->symbols[i].addr == addr) {
-			strncpy(name, program->symbols[i].name, NAMES_LENGTH - 1);
+	int low = 0, high = LIST_LENGTH(program->symbols) - 1, middle;
+
+	// Binary search in symbols sorted by address
+	while (low <= high) {
+		middle = (low + high) / 2;
+		if (program->symbols[middle].addr < addr) {
+			low = middle + 1;
+		} else if (program->symbols[middle].addr > addr) {
+			high = middle - 1;
+		} else {
+			*name = program->symbols[middle].name;
 			return 0;
 		}
 	}
@@ -291,10 +492,17 @@ int vm_get_symbol_name(struct vm_program *program, vmptr_t addr, char *name)
 int vm_get_symbol_addr(struct vm_program *program, const char *name,
 	vmptr_t *addr)
 {
+	uint32_t slot, mask, offset;
 	int i;
 
-	LIST_ITERATOR(program->symbols, i) {
-		if (strcmp(program->symbols[i].name, name) == 0) {
+	if (program->symbols_hash == NULL
+		|| strtab_find(program->strings, name, &offset) != 0)
+		return 1;
+
+	mask = program->symbols_hash_size - 1;
+	for (slot = strtab_hash(name) & mask;
+		(i = program->symbols_hash[slot]) != -1; slot = (slot + 1) & mask) {
+		if (program->symbols[i].name == offset) {
 			*addr = program->symbols[i].addr;
 			return 0;
 		}
@@ -312,5 +520,5 @@ void vm_dump_symbols(struct vm_program *program)
 
 	LIST_ITERATOR(program->symbols, i)
 		printf("symbol:\t0x%x\t%s\n", (int) program->symbols[i].addr,
-			program->symbols[i].name);
+			strtab_get(program->strings, program->symbols[i].name));
 }
@@ -32,15 +32,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "strtab.h"
 
 #define NAMES_LENGTH	64
 
+// Granularity of the address translation table: 4 KiB pages
+#define VM_PAGE_SHIFT	12
+#define VM_NO_SECTION	0xffff
+
 #define ELF_PTABLE_TYPE_NAME(val)	(val==PT_NULL?"PT_NULL":val==PT_LOAD?\
 	"PT_LOAD":val==PT_DYNAMIC?"PT_DYNAMIC":val==PT_INTERP?"PT_INTERP":val==\
 	PT_NOTE?"PT_NOTE":val==PT_SHLIB?"PT_SHLIB":val==PT_PHDR?"PT_PHDR":val==\
@@ -69,29 +75,49 @@ struct vm_elf_section {
 	vmptr_t vaddr;
 	size_t size;
 	void *map_addr;
+	int is_copy; // map_addr was allocated, and does not point into the file
+	int executable;
 };
 
 struct vm_symbol {
 	vmptr_t addr;
-	char name[NAMES_LENGTH];
+	uint32_t name; // offset in program->strings
+};
+
+// Symbol read from the symbols table, before duplicates are merged
+struct vm_raw_symbol {
+	vmptr_t addr;
+	const char *name;
+	int order;
 };
 
 struct vm_program {
 	int fd;
+	void *file_map;
+	size_t file_size;
 	Elf *elf;
-	struct vm_elf_section *sections;
-	struct vm_symbol *symbols;
+	struct vm_elf_section *sections; // sorted by virtual address
+	uint16_t *pages; // for each page, first section that ends after it starts
+	vmptr_t pages_base;
+	size_t pages_count;
+	struct vm_symbol *symbols; // sorted by address
+	int *symbols_hash; // open-addressing table of symbols, by name
+	int symbols_hash_size;
+	struct strtab *strings;
 	Elf32_Addr entrypoint;
 };
 
 struct vm_program *vm_open_program(const char *filename);
 void vm_close_program(struct vm_program *program);
 
-int vm_get_symbol_name(struct vm_program *program, vmptr_t addr, char *name);
+int vm_get_symbol_name(struct vm_program *program, vmptr_t addr,
+	uint32_t *name);
 int vm_get_symbol_addr(struct vm_program *program, const char *name,
 	vmptr_t *addr);
 void vm_dump_symbols(struct vm_program *program);
 
+int vm_find_section(struct vm_program *program, vmptr_t vaddr);
+void *vm_get_data(struct vm_program *program, vmptr_t vaddr, size_t *length);
 uint32_t vm_read_instruction(struct vm_program *program,vmptr_t vaddr);
 
 #endif
@@ -0,0 +1,92 @@
+/**
+ * @file    workers.c
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a simple way to share work between several threads: a
+ * number of items is split into ranges of consecutive items, and each thread
+ * takes the next range until there is none left. Items are processed in any
+ * order, so results are meant to be stored per item (or per range), and merged
+ * in order afterwards.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "workers.h"
+
+struct workers {
+	int count;
+	int range_size;
+	int next; // first item not taken yet
+	void (*process)(void *data, int first, int last);
+	void *data;
+};
+
+static void *workers_thread_main(void *arg)
+{
+	struct workers *workers = arg;
+	int first, last;
+
+	while ((first = __atomic_fetch_add(&(workers->next), workers->range_size,
+		__ATOMIC_RELAXED)) < workers->count) {
+		last = first + workers->range_size;
+		if (last > workers->count)
+			last = workers->count;
+		workers->process(workers->data, first, last);
+	}
+
+	return NULL;
+}
+
+/**
+ * Calls process() on all ranges of at most range_size items, in [0, count),
+ * with jobs threads, and waits until they are done. With one job, or when
+ * there is only one range, everything is done by the calling thread.
+ */
+void workers_run(int jobs, int count, int range_size,
+	void (*process)(void *data, int first, int last), void *data)
+{
+	struct workers workers;
+	pthread_t *threads;
+	int i;
+
+	workers.count = count;
+	workers.range_size = range_size;
+	workers.next = 0;
+	workers.process = process;
+	workers.data = data;
+
+	if (jobs == 1 || count <= range_size) {
+		workers_thread_main(&workers);
+		return;
+	}
+
+	threads = calloc(jobs, sizeof(pthread_t));
+	if (threads == NULL)
+		FATAL_ERROR("calloc");
+	for (i = 0; i < jobs; i++)
+		if (pthread_create(&(threads[i]), NULL, workers_thread_main,
+			&workers) != 0)
+			FATAL_ERROR("pthread_create");
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
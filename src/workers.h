@@ -0,0 +1,39 @@
+/**
+ * @file    workers.h
+ * @author  Adrien Vergé <adrien.verge@polymtl.ca>
+ * @date    March 2013
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * This file gives a simple way to share work between several threads: a
+ * number of items is split into ranges of consecutive items, and each thread
+ * takes the next range until there is none left. Items are processed in any
+ * order, so results are meant to be stored per item (or per range), and merged
+ * in order afterwards.
+ */
+
+#if !defined(WORKERS_H)
+#define WORKERS_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+void workers_run(int jobs, int count, int range_size,
+	void (*process)(void *data, int first, int last), void *data);
+
+#endif